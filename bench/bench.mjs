@@ -0,0 +1,177 @@
+// End-to-end benchmark of encode() and decode(), including N-API
+// marshalling, the promise machinery and the thread-pool hop.
+//
+//   npm run bench -- [--lengths=1000,100000] [--types=float,boolean] [--concurrency=1,4] [--quick]
+//
+// Results are written to stdout as JSON so releases can be compared,
+// progress goes to stderr.
+
+import os from "node:os";
+import { readFileSync } from "node:fs";
+import { performance } from "node:perf_hooks";
+import { createRequire } from "module";
+const require = createRequire(import.meta.url);
+const GorillaCodec = require("../lib/binding.js");
+
+const args = Object.fromEntries(
+  process.argv.slice(2).map((arg) => {
+    const [key, value] = arg.replace(/^--/, "").split("=");
+    return [key, value ?? "true"];
+  })
+);
+
+const quick = args.quick === "true";
+const list = (value, fallback) => (value ? value.split(",") : fallback);
+
+const lengths = list(args.lengths, quick ? ["1000", "100000"] : ["100", "10000", "100000", "1000000"]).map(Number);
+const concurrencies = list(args.concurrency, quick ? ["1", "4"] : ["1", "4", "16"]).map(Number);
+const pointBudget = quick ? 2e6 : 2e7;
+
+// Deterministic pseudo random numbers so every run sees the same data
+function random(seed) {
+  let state = seed;
+  return () => {
+    state = (state * 1664525 + 1013904223) >>> 0;
+    return state / 4294967296;
+  };
+}
+
+const generators = {
+  float: (length, rand) => {
+    let value = 100;
+    return Array.from({ length }, () => (value += rand() - 0.5));
+  },
+  integer: (length, rand) => {
+    let value = 0;
+    return Array.from({ length }, () => (value += Math.floor(rand() * 10)));
+  },
+  decimal: (length, rand) => Array.from({ length }, () => Math.floor(rand() * 70000) / 100),
+  boolean: (length, rand) => {
+    let value = true;
+    return Array.from({ length }, () => (rand() < 0.001 ? (value = !value) : value));
+  },
+  "string-states": (length, rand) => {
+    const states = ["ok", "warning", "critical", "unknown"];
+    return Array.from({ length }, () => states[Math.floor(rand() * states.length)]);
+  },
+  "string-paths": (length) => Array.from({ length }, (_, i) => `/api/v1/series/${Math.floor(i / 3)}/points`),
+};
+
+const types = list(args.types, Object.keys(generators));
+
+function dataset(type, length) {
+  const rand = random(length);
+  const timestamps = [];
+
+  let timestamp = 1704747969000;
+  for (let i = 0; i < length; i++) {
+    timestamp += 10000 + Math.floor(rand() * 5 - 2) * 1000;
+    timestamps.push(timestamp);
+  }
+
+  const values = generators[type](length, rand);
+
+  // Raw size as 8 byte timestamps plus the natural size of each value
+  const valueBytes = values.reduce(
+    (sum, value) => sum + (typeof value === "string" ? Buffer.byteLength(value) : typeof value === "boolean" ? 1 : 8),
+    0
+  );
+
+  return { data: { timestamps, values }, rawBytes: length * 8 + valueBytes };
+}
+
+function percentile(sorted, p) {
+  return sorted[Math.min(sorted.length - 1, Math.floor((sorted.length * p) / 100))];
+}
+
+// Runs `iterations` operations with `concurrency` of them in flight at once
+async function measure(operation, iterations, concurrency, length) {
+  const latencies = [];
+  let started = 0;
+
+  const worker = async () => {
+    while (started < iterations) {
+      started++;
+
+      const begin = performance.now();
+      await operation();
+      latencies.push(performance.now() - begin);
+    }
+  };
+
+  const begin = performance.now();
+  await Promise.all(Array.from({ length: concurrency }, worker));
+  const elapsed = (performance.now() - begin) / 1000;
+
+  latencies.sort((a, b) => a - b);
+
+  return {
+    opsPerSec: iterations / elapsed,
+    pointsPerSec: (iterations * length) / elapsed,
+    p50Ms: percentile(latencies, 50),
+    p90Ms: percentile(latencies, 90),
+    p99Ms: percentile(latencies, 99),
+    maxMs: latencies[latencies.length - 1],
+  };
+}
+
+const results = [];
+
+for (const type of types) {
+  for (const length of lengths) {
+    const { data, rawBytes } = dataset(type, length);
+
+    const encoded = await GorillaCodec.encode(data);
+    const iterations = Math.max(10, Math.min(10000, Math.floor(pointBudget / length)));
+
+    // Warm up both paths before timing them
+    for (let i = 0; i < Math.min(iterations, 5); i++) {
+      await GorillaCodec.decode(await GorillaCodec.encode(data));
+    }
+
+    for (const concurrency of concurrencies) {
+      const encode = await measure(() => GorillaCodec.encode(data), iterations, concurrency, length);
+      const decode = await measure(() => GorillaCodec.decode(encoded), iterations, concurrency, length);
+
+      const result = {
+        type,
+        length,
+        concurrency,
+        iterations,
+        rawBytes,
+        encodedBytes: encoded.length,
+        ratio: rawBytes / encoded.length,
+        bitsPerPoint: (encoded.length * 8) / length,
+        encode,
+        decode,
+      };
+
+      results.push(result);
+
+      console.error(
+        `${type.padEnd(14)} n=${String(length).padEnd(8)} c=${String(concurrency).padEnd(3)}` +
+          ` encode ${(encode.pointsPerSec / 1e6).toFixed(2).padStart(8)} Mpts/s p99 ${encode.p99Ms.toFixed(2).padStart(8)} ms` +
+          ` decode ${(decode.pointsPerSec / 1e6).toFixed(2).padStart(8)} Mpts/s p99 ${decode.p99Ms.toFixed(2).padStart(8)} ms` +
+          ` ratio ${result.ratio.toFixed(2)}`
+      );
+    }
+  }
+}
+
+const pkg = JSON.parse(readFileSync(new URL("../package.json", import.meta.url)));
+
+console.log(
+  JSON.stringify(
+    {
+      version: pkg.version,
+      node: process.version,
+      platform: `${os.platform()}-${os.arch()}`,
+      cpu: os.cpus()[0]?.model,
+      threadPoolSize: Number(process.env.UV_THREADPOOL_SIZE ?? 4),
+      date: new Date().toISOString(),
+      results,
+    },
+    null,
+    2
+  )
+);
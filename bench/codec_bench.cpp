@@ -0,0 +1,556 @@
+// Native micro-benchmarks for the codec kernels, runs without Node.
+//
+//   node-gyp rebuild --gorilla_bench=true
+//   ./build/Release/gorilla-codec-bench [filter]
+//
+// Every kernel is timed on synthetic datasets and reported as ns/point and
+// GB/s of raw input for encode and decode, plus the encoded bits/point.
+
+#include "boolean_encoder.hpp"
+#include "float_encoder.hpp"
+#include "integer_encoder.hpp"
+#include "simple8b.hpp"
+#include "string_encoder.hpp"
+#include "zigzag.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+static const size_t points = 1000000;
+
+// Keeps the optimiser from dropping decoded output
+static volatile uint64_t sink = 0;
+
+struct Measurement {
+  double encodeNs = 0;
+  double decodeNs = 0;
+  size_t rawBytes = 0;
+  size_t encodedBytes = 0;
+  size_t count = 0;
+};
+
+// Best time of several runs, in nanoseconds
+static double timeNs(const std::function<void()>& run) {
+  using clock = std::chrono::steady_clock;
+
+  double best = std::numeric_limits<double>::max();
+  const auto start = clock::now();
+
+  for (int runs = 0; runs < 3 || (clock::now() - start < std::chrono::milliseconds(250) && runs < 1000); runs++) {
+    const auto begin = clock::now();
+    run();
+    const auto end = clock::now();
+
+    best = std::min(best, static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()));
+  }
+
+  return best;
+}
+
+static void report(const char* dataset, const char* codec, const Measurement& m) {
+  const double n = static_cast<double>(m.count);
+
+  std::printf("%-18s %-14s %9.2f ns/pt %7.2f GB/s | %9.2f ns/pt %7.2f GB/s | %7.2f bits/pt\n", dataset, codec,
+              m.encodeNs / n, m.rawBytes / m.encodeNs, m.decodeNs / n, m.rawBytes / m.decodeNs,
+              m.encodedBytes * 8.0 / n);
+}
+
+static bool selected(const char* filter, const char* dataset, const char* codec) {
+  return filter == nullptr || std::strstr(dataset, filter) != nullptr || std::strstr(codec, filter) != nullptr;
+}
+
+// Datasets
+
+static std::vector<uint64_t> regularTimestamps() {
+  std::vector<uint64_t> values(points);
+  for (size_t i = 0; i < points; i++) values[i] = 1704747969000ull + i * 10000;
+  return values;
+}
+
+static std::vector<uint64_t> jitteryTimestamps(uint64_t stride) {
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int> jitter(-20, 20);
+
+  std::vector<uint64_t> values(points);
+  uint64_t timestamp = 1704747969000ull;
+
+  for (size_t i = 0; i < points; i++) {
+    timestamp += 10000 + jitter(rng) * stride;
+    values[i] = timestamp;
+  }
+
+  return values;
+}
+
+// Regular scrapes with a missed one now and then
+static std::vector<uint64_t> gappyTimestamps() {
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> uniform(0, 1);
+
+  std::vector<uint64_t> values(points);
+  uint64_t timestamp = 1704747969000ull;
+
+  for (size_t i = 0; i < points; i++) {
+    timestamp += uniform(rng) < 0.005 ? 10000 * (2 + rng() % 100) : 10000;
+    values[i] = timestamp;
+  }
+
+  return values;
+}
+
+static std::vector<double> randomWalk() {
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> step(0, 1);
+
+  std::vector<double> values(points);
+  double value = 100;
+
+  for (size_t i = 0; i < points; i++) {
+    value += step(rng);
+    values[i] = value;
+  }
+
+  return values;
+}
+
+static std::vector<double> constant() { return std::vector<double>(points, 42.5); }
+
+static std::vector<double> sparse() {
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> uniform(0, 1);
+
+  std::vector<double> values(points);
+  for (size_t i = 0; i < points; i++) values[i] = uniform(rng) < 0.01 ? uniform(rng) * 1000 : 0;
+  return values;
+}
+
+// A daily load curve sampled every minute, repeating exactly apart from occasional spikes
+static std::vector<double> seasonal() {
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> uniform(0, 1);
+
+  std::vector<double> values(points);
+
+  for (size_t i = 0; i < points; i++) {
+    const double curve = std::round(std::sin(i % 1440 * 2 * M_PI / 1440) * 5000) / 100 + 60;
+    values[i] = uniform(rng) < 0.001 ? curve * 2 : curve;
+  }
+
+  return values;
+}
+
+// An idle gauge sampled every second, holding each reading for minutes to hours
+static std::vector<double> flatline() {
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int> hold(60, 3 * 3600);
+  std::uniform_int_distribution<int> cents(0, 10000);
+
+  std::vector<double> values(points);
+
+  for (size_t i = 0; i < points;) {
+    const double reading = cents(rng) / 100.0;
+    const size_t end = std::min(points, i + hold(rng));
+
+    for (; i < end; i++) values[i] = reading;
+  }
+
+  return values;
+}
+
+// A request counter and a queue depth gauge, whole numbers stored as doubles
+static std::vector<double> counter() {
+  std::mt19937_64 rng(42);
+  std::poisson_distribution<int> requests(40);
+
+  std::vector<double> values(points);
+  double total = 0;
+
+  for (size_t i = 0; i < points; i++) values[i] = total += requests(rng);
+  return values;
+}
+
+static std::vector<double> queueDepth() {
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int> step(-3, 3);
+
+  std::vector<double> values(points);
+  int depth = 100;
+
+  for (size_t i = 0; i < points; i++) values[i] = depth = std::max(0, depth + step(rng));
+  return values;
+}
+
+static std::vector<double> decimal() {
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int> cents(0, 70000);
+
+  std::vector<double> values(points);
+  for (size_t i = 0; i < points; i++) values[i] = cents(rng) / 100.0;
+  return values;
+}
+
+static std::vector<uint8_t> flapping() {
+  std::mt19937_64 rng(42);
+
+  std::vector<uint8_t> values(points);
+  for (size_t i = 0; i < points; i++) values[i] = rng() & 1;
+  return values;
+}
+
+static std::vector<uint8_t> health() {
+  std::vector<uint8_t> values(points, 1);
+  for (size_t i = 400000; i < 400100; i++) values[i] = 0;
+  return values;
+}
+
+static std::vector<std::string> states() {
+  const char* names[] = {"ok", "warning", "critical", "unknown", "pending"};
+
+  std::vector<std::string> values(points);
+  for (size_t i = 0; i < points; i++) values[i] = names[(i / 7) % 5];
+  return values;
+}
+
+static std::vector<std::string> paths() {
+  std::vector<std::string> values(points);
+  for (size_t i = 0; i < points; i++) values[i] = "/api/v1/series/" + std::to_string(i / 3) + "/points";
+  return values;
+}
+
+static std::vector<std::string> randomStrings() {
+  std::mt19937_64 rng(42);
+
+  std::vector<std::string> values(points);
+  for (size_t i = 0; i < points; i++) values[i] = std::to_string(rng());
+  return values;
+}
+
+static size_t stringBytes(const std::vector<std::string>& values) {
+  size_t bytes = 0;
+  for (const auto& value : values) bytes += value.size();
+  return bytes;
+}
+
+// Kernels
+
+static Measurement benchSimple8B(const std::vector<uint64_t>& timestamps) {
+  std::vector<uint64_t> values(timestamps.size());
+  values[0] = 0;
+  for (size_t i = 1; i < values.size(); i++) {
+    values[i] = ZigZag::zigzagEncode(static_cast<int64_t>(timestamps[i] - timestamps[i - 1]) - 10000);
+  }
+
+  Measurement m;
+  m.count = values.size();
+  m.rawBytes = values.size() * sizeof(uint64_t);
+
+  AlignedBuffer encoded;
+  m.encodeNs = timeNs([&] { encoded = Simple8B::encode(values); });
+  m.encodedBytes = encoded.size();
+
+  m.decodeNs = timeNs([&] {
+    Slice slice(encoded.data.data(), encoded.size());
+    sink += Simple8B::decode(slice).size();
+  });
+
+  return m;
+}
+
+static Measurement benchInteger(const std::vector<uint64_t>& values) {
+  Measurement m;
+  m.count = values.size();
+  m.rawBytes = values.size() * sizeof(uint64_t);
+
+  AlignedBuffer encoded;
+  uint64_t divisor = 1;
+
+  m.encodeNs = timeNs([&] {
+    divisor = IntegerEncoder::commonDivisor(values);
+    encoded = IntegerEncoder::encode(values, divisor);
+  });
+  m.encodedBytes = encoded.size() + (divisor > 1 ? sizeof(uint64_t) : 0);
+
+  m.decodeNs = timeNs([&] {
+    std::vector<uint64_t> out;
+    out.reserve(values.size());
+
+    Slice slice(encoded.data.data(), encoded.size());
+    IntegerEncoder::decode(slice, out, values.size(), divisor);
+    sink += out.back();
+  });
+
+  return m;
+}
+
+// The timestamps section encode picks, divisor and layout choice included
+static Measurement benchTimestamps(const std::vector<uint64_t>& values) {
+  Measurement m;
+  m.count = values.size();
+  m.rawBytes = values.size() * sizeof(uint64_t);
+
+  AlignedBuffer encoded;
+  uint64_t divisor = 1;
+  bool hybrid = false;
+
+  m.encodeNs = timeNs([&] {
+    encoded = AlignedBuffer();
+    divisor = IntegerEncoder::commonDivisor(values);
+    hybrid = IntegerEncoder::encodeSmallest(values, divisor, encoded);
+  });
+  m.encodedBytes = encoded.size() + (!hybrid && divisor > 1 ? sizeof(uint64_t) : 0);
+
+  std::vector<uint64_t> out(values.size());
+  m.decodeNs = timeNs([&] {
+    Slice slice(encoded.data.data(), encoded.size());
+    sink += hybrid ? IntegerEncoder::decodeHybrid(slice, out.data(), out.size())
+                   : IntegerEncoder::decode(slice, out.data(), out.size(), divisor);
+  });
+
+  return m;
+}
+
+static Measurement benchPfor(const std::vector<uint64_t>& values) {
+  Measurement m;
+  m.count = values.size();
+  m.rawBytes = values.size() * sizeof(uint64_t);
+
+  AlignedBuffer encoded;
+  m.encodeNs = timeNs([&] { encoded = IntegerEncoder::encodeHybrid(values, IntegerEncoder::commonDivisor(values)); });
+  m.encodedBytes = encoded.size();
+
+  std::vector<uint64_t> out(values.size());
+  m.decodeNs = timeNs([&] {
+    Slice slice(encoded.data.data(), encoded.size());
+    sink += IntegerEncoder::decodeHybrid(slice, out.data(), out.size());
+  });
+
+  return m;
+}
+
+enum class FloatCodec { Gorilla, Entropy, Fpc, Shuffle, Runs, Integers };
+
+static Measurement benchFloat(const std::vector<double>& values, FloatCodec codec) {
+  Measurement m;
+  m.count = values.size();
+  m.rawBytes = values.size() * sizeof(double);
+
+  if (codec == FloatCodec::Gorilla) {
+    CompressedBuffer encoded;
+    m.encodeNs = timeNs([&] { encoded = FloatEncoder::encode(values); });
+    m.encodedBytes = encoded.dataByteSize();
+
+    m.decodeNs = timeNs([&] {
+      std::vector<double> out;
+      out.reserve(values.size());
+
+      Slice slice(reinterpret_cast<const uint8_t*>(encoded.data.data()), encoded.dataByteSize());
+      FloatEncoder::decode(slice, out, values.size());
+      sink += out.size();
+    });
+
+    return m;
+  }
+
+  AlignedBuffer encoded;
+  m.encodeNs = timeNs([&] {
+    encoded = AlignedBuffer();
+
+    if (codec == FloatCodec::Entropy) {
+      FloatEncoder::encodeEntropy(values, encoded);
+    } else if (codec == FloatCodec::Fpc) {
+      FloatEncoder::encodeFpc(values, encoded);
+    } else if (codec == FloatCodec::Shuffle) {
+      FloatEncoder::encodeShuffle(values, encoded);
+    } else if (codec == FloatCodec::Runs) {
+      FloatEncoder::encodeRuns(values, encoded);
+    } else {
+      FloatEncoder::encodeIntegers(values, encoded);
+    }
+  });
+  m.encodedBytes = encoded.size();
+
+  std::vector<double> out(values.size());
+  m.decodeNs = timeNs([&] {
+    Slice slice(encoded.data.data(), encoded.size());
+
+    if (codec == FloatCodec::Entropy) {
+      sink += FloatEncoder::decodeEntropy(slice, out.data(), out.size());
+    } else if (codec == FloatCodec::Fpc) {
+      sink += FloatEncoder::decodeFpc(slice, out.data(), out.size());
+    } else if (codec == FloatCodec::Shuffle) {
+      sink += FloatEncoder::decodeShuffle(slice, out.data(), out.size());
+    } else if (codec == FloatCodec::Runs) {
+      sink += FloatEncoder::decodeRuns(slice, out.data(), out.size());
+    } else {
+      sink += FloatEncoder::decodeIntegers(slice, out.data(), out.size());
+    }
+  });
+
+  return m;
+}
+
+static Measurement benchBoolean(const std::vector<uint8_t>& values) {
+  Measurement m;
+  m.count = values.size();
+  m.rawBytes = values.size();
+
+  AlignedBuffer encoded;
+  m.encodeNs = timeNs([&] { encoded = BooleanEncoder::encode(values.data(), values.size()); });
+  m.encodedBytes = encoded.size();
+
+  std::vector<uint8_t> out(values.size());
+  m.decodeNs = timeNs([&] {
+    Slice slice(encoded.data.data(), encoded.size());
+    BooleanEncoder::decode(slice, out.data(), out.size());
+    sink += out.back();
+  });
+
+  return m;
+}
+
+enum class StringCodec { Snappy, Dictionary, FrontCoded };
+
+static Measurement benchString(const std::vector<std::string>& values, StringCodec codec) {
+  Measurement m;
+  m.count = values.size();
+  m.rawBytes = stringBytes(values);
+
+  AlignedBuffer encoded;
+  bool supported = true;
+
+  m.encodeNs = timeNs([&] {
+    encoded = AlignedBuffer();
+
+    switch (codec) {
+      case StringCodec::Snappy:
+        StringEncoder::encodeSnappy(values, encoded);
+        break;
+      case StringCodec::Dictionary:
+        supported = StringEncoder::encodeDictionary(values, encoded);
+        break;
+      case StringCodec::FrontCoded:
+        supported = StringEncoder::encodeFrontCoded(values, encoded);
+        break;
+    }
+  });
+
+  if (!supported) return Measurement();
+
+  m.encodedBytes = encoded.size();
+
+  m.decodeNs = timeNs([&] {
+    Slice slice(encoded.data.data(), encoded.size());
+
+    switch (codec) {
+      case StringCodec::Snappy: {
+        std::vector<std::string> out;
+        StringEncoder::decodeSnappy(slice, out, values.size());
+        sink += out.size();
+        break;
+      }
+      case StringCodec::Dictionary: {
+        std::vector<std::string> dictionary;
+        std::vector<uint64_t> codes;
+        StringEncoder::decodeDictionary(slice, dictionary, codes, values.size());
+        sink += codes.size();
+        break;
+      }
+      case StringCodec::FrontCoded: {
+        std::vector<std::string> out;
+        StringEncoder::decodeFrontCoded(slice, out, values.size());
+        sink += out.size();
+        break;
+      }
+    }
+  });
+
+  return m;
+}
+
+int main(int argc, char** argv) {
+  const char* filter = argc > 1 ? argv[1] : nullptr;
+
+  std::printf("%-18s %-14s %28s | %28s | %12s\n", "dataset", "codec", "encode", "decode", "size");
+
+  const std::pair<const char*, std::function<std::vector<uint64_t>()>> timestampSets[] = {
+      {"ts-regular", regularTimestamps},
+      {"ts-jitter-ms", [] { return jitteryTimestamps(1); }},
+      {"ts-jitter-1000ms", [] { return jitteryTimestamps(1000); }},
+      {"ts-gaps", gappyTimestamps}};
+
+  for (const auto& set : timestampSets) {
+    if (!selected(filter, set.first, "simple8b") && !selected(filter, set.first, "integer")) continue;
+
+    const std::vector<uint64_t> values = set.second();
+
+    if (selected(filter, set.first, "simple8b")) report(set.first, "simple8b", benchSimple8B(values));
+    if (selected(filter, set.first, "integer")) report(set.first, "integer", benchInteger(values));
+    if (selected(filter, set.first, "integer")) report(set.first, "integer-pfor", benchPfor(values));
+    if (selected(filter, set.first, "integer")) report(set.first, "integer-best", benchTimestamps(values));
+  }
+
+  const std::pair<const char*, std::function<std::vector<double>()>> floatSets[] = {
+      {"float-random-walk", randomWalk}, {"float-constant", constant}, {"float-sparse", sparse}, {"float-decimal", decimal},
+      {"float-seasonal", seasonal}, {"float-flatline", flatline}, {"float-counter", counter},
+      {"float-queue-depth", queueDepth}};
+
+  const std::pair<const char*, FloatCodec> floatCodecs[] = {
+      {"gorilla", FloatCodec::Gorilla},       {"gorilla-entropy", FloatCodec::Entropy},
+      {"fpc", FloatCodec::Fpc},               {"shuffle-snappy", FloatCodec::Shuffle},
+      {"gorilla-runs", FloatCodec::Runs},     {"integers", FloatCodec::Integers}};
+
+  for (const auto& set : floatSets) {
+    const std::vector<double> values = set.second();
+
+    for (const auto& codec : floatCodecs) {
+      if (!selected(filter, set.first, codec.first)) continue;
+
+      // Only whole numbers survive the integer codec
+      if (codec.second == FloatCodec::Integers && !FloatEncoder::isIntegral(values)) continue;
+
+      report(set.first, codec.first, benchFloat(values, codec.second));
+    }
+  }
+
+  const std::pair<const char*, std::function<std::vector<uint8_t>()>> booleanSets[] = {{"bool-flapping", flapping},
+                                                                                      {"bool-health", health}};
+
+  for (const auto& set : booleanSets) {
+    if (!selected(filter, set.first, "boolean")) continue;
+
+    report(set.first, "boolean", benchBoolean(set.second()));
+  }
+
+  const std::pair<const char*, std::function<std::vector<std::string>()>> stringSets[] = {
+      {"string-states", states}, {"string-paths", paths}, {"string-random", randomStrings}};
+
+  const std::pair<const char*, StringCodec> stringCodecs[] = {
+      {"snappy", StringCodec::Snappy}, {"dictionary", StringCodec::Dictionary}, {"front-coded", StringCodec::FrontCoded}};
+
+  for (const auto& set : stringSets) {
+    const std::vector<std::string> values = set.second();
+
+    for (const auto& codec : stringCodecs) {
+      if (!selected(filter, set.first, codec.first)) continue;
+
+      const Measurement m = benchString(values, codec.second);
+
+      if (m.count == 0) {
+        std::printf("%-18s %-14s %28s\n", set.first, codec.first, "not applicable");
+        continue;
+      }
+
+      report(set.first, codec.first, m);
+    }
+  }
+
+  return sink == 0xffffffffffffffffull ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+// Compares two JSON reports written by bench.mjs and flags regressions.
+//
+//   node bench/compare.mjs baseline.json current.json [--threshold=10]
+//
+// Exits with status 1 when throughput drops or encoded size grows by more
+// than the threshold percentage for any configuration present in both.
+
+import { readFileSync } from "node:fs";
+
+const [baselinePath, currentPath, ...rest] = process.argv.slice(2);
+
+if (!baselinePath || !currentPath) {
+  console.error("Usage: node bench/compare.mjs baseline.json current.json [--threshold=10]");
+  process.exit(2);
+}
+
+const thresholdArg = rest.find((arg) => arg.startsWith("--threshold="));
+const threshold = thresholdArg ? Number(thresholdArg.split("=")[1]) : 10;
+
+const load = (path) => JSON.parse(readFileSync(path, "utf8"));
+const key = (result) => `${result.type} n=${result.length} c=${result.concurrency}`;
+
+const baseline = new Map(load(baselinePath).results.map((result) => [key(result), result]));
+const current = load(currentPath).results;
+
+const change = (before, after) => ((after - before) / before) * 100;
+let regressions = 0;
+
+for (const result of current) {
+  const before = baseline.get(key(result));
+  if (!before) continue;
+
+  const checks = [
+    ["encode", change(before.encode.pointsPerSec, result.encode.pointsPerSec), -1],
+    ["decode", change(before.decode.pointsPerSec, result.decode.pointsPerSec), -1],
+    ["size", change(before.encodedBytes, result.encodedBytes), 1],
+  ];
+
+  const line = checks.map(([name, delta]) => `${name} ${delta >= 0 ? "+" : ""}${delta.toFixed(1)}%`).join("  ");
+  const regressed = checks.some(([, delta, direction]) => delta * direction > threshold);
+
+  if (regressed) regressions++;
+
+  console.log(`${regressed ? "REGRESSION" : "ok        "} ${key(result).padEnd(32)} ${line}`);
+}
+
+process.exit(regressions > 0 ? 1 : 0);
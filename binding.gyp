@@ -1,8 +1,17 @@
 {
+  'variables': {
+    # Set with `node-gyp rebuild --gorilla_bench=true` to build the native benchmarks
+    'gorilla_bench%': 'false',
+    # Set with `node-gyp rebuild --gorilla_stats=false` to compile out the getStats() instrumentation
+    'gorilla_stats%': 'true',
+    # Set with `node-gyp rebuild --gorilla_usdt=false` to leave out the USDT probes (only built where sys/sdt.h exists)
+    'gorilla_usdt%': 'true',
+    'codec_sources': [ "src/aligned_buffer.cpp", "src/compressed_buffer.cpp", "src/integer_encoder.cpp", "src/simple8b.cpp", "src/float_encoder.cpp", "src/huffman.cpp", "src/string_encoder.cpp", "src/boolean_encoder.cpp", "src/stats.cpp", "src/segment.cpp" ],
+  },
   'targets': [
     {
       'target_name': 'gorilla-codec-native',
-      'sources': [ 'src/gorilla_codec.cc', "src/aligned_buffer.cpp", "src/compressed_buffer.cpp", "src/integer_encoder.cpp", "src/simple8b.cpp", "src/float_encoder.cpp" ],
+      'sources': [ 'src/gorilla_codec.cc', '<@(codec_sources)' ],
       'include_dirs': ["<!@(node -p \"require('node-addon-api').include\")", "/usr/local/include"],
       'dependencies': ["<!(node -p \"require('node-addon-api').gyp\")"],
       'cflags!': [ '-fno-exceptions' ],
@@ -20,6 +29,37 @@
         "-L/usr/local/lib",
         "-lsnappy"
       ],
+      'conditions': [
+        ['gorilla_stats=="true"', { 'defines': [ 'GORILLA_STATS' ] }],
+        ['gorilla_usdt=="true"', { 'defines': [ 'GORILLA_USDT' ] }]
+      ],
     }
+  ],
+  'conditions': [
+    ['gorilla_bench=="true"', {
+      'targets': [
+        {
+          'target_name': 'gorilla-codec-bench',
+          'type': 'executable',
+          'sources': [ 'bench/codec_bench.cpp', '<@(codec_sources)' ],
+          'include_dirs': ["src", "/usr/local/include"],
+          'cflags!': [ '-fno-exceptions' ],
+          'cflags_cc!': [ '-fno-exceptions' ],
+          "cflags_cc": ["-std=c++17"],
+          'xcode_settings': {
+            'GCC_ENABLE_CPP_EXCEPTIONS': 'YES',
+            'CLANG_CXX_LIBRARY': 'libc++',
+            'MACOSX_DEPLOYMENT_TARGET': '10.7'
+          },
+          'msvs_settings': {
+            'VCCLCompilerTool': { 'ExceptionHandling': 1 },
+          },
+          "libraries": [
+            "-L/usr/local/lib",
+            "-lsnappy"
+          ],
+        }
+      ]
+    }]
   ]
-}
\ No newline at end of file
+}
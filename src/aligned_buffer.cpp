@@ -11,7 +11,7 @@ template <class T> void AlignedBuffer::write(T value) {
   memcpy(&data.back() - bytesToAdd + 1, (uint8_t *)&value, bytesToAdd);
 };
 
-void AlignedBuffer::write(std::string &value) {
+void AlignedBuffer::write(const std::string &value) {
   const int bytesToAdd = value.length();
   data.resize(data.size() + bytesToAdd);
 
@@ -20,6 +20,9 @@ void AlignedBuffer::write(std::string &value) {
 
 void AlignedBuffer::write(CompressedBuffer &value) {
   const int bytesToAdd = value.dataByteSize();
+  if (bytesToAdd == 0)
+    return;
+
   data.resize(data.size() + bytesToAdd);
 
   memcpy(&data.back() - bytesToAdd + 1, (uint8_t *)&value.data[0], bytesToAdd);
@@ -27,6 +30,9 @@ void AlignedBuffer::write(CompressedBuffer &value) {
 
 void AlignedBuffer::write(AlignedBuffer &value) {
   const int bytesToAdd = value.size();
+  if (bytesToAdd == 0)
+    return;
+
   data.resize(data.size() + bytesToAdd);
 
   memcpy(&data.back() - bytesToAdd + 1, (uint8_t *)&value.data[0], bytesToAdd);
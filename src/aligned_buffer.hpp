@@ -18,7 +18,7 @@ public:
   };
 
   template <class T> void write(T value);
-  void write(std::string &value);
+  void write(const std::string &value);
   void write(CompressedBuffer &value);
   void write(AlignedBuffer &value);
 
@@ -0,0 +1,62 @@
+#ifndef __BIT_READER_H_INCLUDED__
+#define __BIT_READER_H_INCLUDED__
+
+#include <cstdint>
+#include <cstring>
+
+// Reads a stream of 64 bit words, least significant bit first, through a 64
+// bit window instead of bit by bit. Checked reads past the end of the stream
+// return zero bits rather than faulting, unchecked reads are for callers that
+// know enough words are left
+class BitReader {
+ private:
+  const uint8_t* data = nullptr;
+  size_t words = 0;
+  size_t position = 0;
+
+  template <bool checked>
+  uint64_t word(size_t index) const {
+    if (checked && index >= words) return 0;
+
+    uint64_t loaded;
+    std::memcpy(&loaded, data + index * sizeof(uint64_t), sizeof(uint64_t));
+    return loaded;
+  }
+
+ public:
+  BitReader() = default;
+  BitReader(const uint8_t* _data, size_t length) : data(_data), words(length / sizeof(uint64_t)) {}
+
+  // The next 64 bits of the stream, the high word is shifted in two steps so a shift of 0 needs no branch
+  template <bool checked = true>
+  uint64_t peek() const {
+    const size_t index = position / 64;
+    const int shift = position % 64;
+
+    return (word<checked>(index) >> shift) | ((word<checked>(index + 1) << 1) << (63 - shift));
+  }
+
+  void skip(size_t bits) { position += bits; }
+
+  // Reads 1 to 64 bits
+  template <bool checked = true>
+  uint64_t read(int bits) {
+    const uint64_t value = peek<checked>();
+    position += bits;
+
+    return bits == 64 ? value : value & ((1ull << bits) - 1);
+  }
+
+  // Whether reads went past the end of the stream, which checked reads fill with zero bits
+  bool overran() const { return position > words * 64; }
+
+  // How many more bits can be read without checking, counting the word a peek reads past them
+  size_t uncheckedBits() const {
+    const size_t end = words * 64;
+    const size_t reach = position + 2 * 64;
+
+    return end > reach ? end - reach : 0;
+  }
+};
+
+#endif
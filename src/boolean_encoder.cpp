@@ -0,0 +1,242 @@
+#include "boolean_encoder.hpp"
+#include "simple8b.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+// Layout:
+//   [uint32 count] then per block of up to blockSize values either
+//   [uint8 BITPACKED][ceil(n / 64) uint64 words] or
+//   [uint8 RUN_LENGTH][uint8 first value][uint32 byte length][Simple8B run lengths]
+
+uint64_t BooleanEncoder::pack64(const uint8_t* values) {
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t bits = 0;
+
+  for (int i = 0; i < 4; i++) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i * 16));
+    const uint64_t mask = static_cast<uint16_t>(~_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero)));
+    bits |= mask << (i * 16);
+  }
+
+  return bits;
+#else
+  uint64_t bits = 0;
+
+  for (int i = 0; i < 8; i++) {
+    uint64_t chunk;
+    std::memcpy(&chunk, values + i * 8, sizeof(chunk));
+    bits |= ((chunk * 0x0102040810204080ull) >> 56) << (i * 8);
+  }
+
+  return bits;
+#endif
+}
+
+uint64_t BooleanEncoder::unpack8(uint64_t bits) {
+#if defined(__BMI2__)
+  return _pdep_u64(bits, 0x0101010101010101ull);
+#else
+  const uint64_t spread = ((bits & 0xff) * 0x0101010101010101ull) & 0x8040201008040201ull;
+  return ((spread + 0x7f7f7f7f7f7f7f7full) >> 7) & 0x0101010101010101ull;
+#endif
+}
+
+static void packBlock(const uint8_t* values, size_t size, std::vector<uint64_t>& words) {
+  words.resize((size + 63) / 64);
+
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    words[i / 64] = BooleanEncoder::pack64(values + i);
+  }
+
+  if (i < size) {
+    uint8_t tail[64] = {0};
+    std::memcpy(tail, values + i, size - i);
+    words[i / 64] = BooleanEncoder::pack64(tail);
+  }
+}
+
+// Collects the run lengths of a packed block, giving up once there are more than maxRuns
+static bool collectRuns(const std::vector<uint64_t>& words, size_t size, size_t maxRuns, std::vector<uint64_t>& runs) {
+  bool current = words[0] & 1;
+  uint64_t run = 0;
+  size_t position = 0;
+
+  while (position < size) {
+    const size_t bit = position % 64;
+    const size_t available = std::min<size_t>(64 - bit, size - position);
+    const uint64_t word = words[position / 64];
+    const uint64_t differs = (current ? ~word : word) >> bit;
+    const size_t same = getTrailingZeroBits(differs);
+
+    if (same >= available) {
+      run += available;
+      position += available;
+      continue;
+    }
+
+    run += same;
+    position += same;
+
+    runs.push_back(run);
+    if (runs.size() > maxRuns) return false;
+
+    run = 0;
+    current = !current;
+  }
+
+  runs.push_back(run);
+
+  return true;
+}
+
+// Run length blocks are only kept when smaller than the bitpacked words
+size_t BooleanEncoder::maxEncodedSize(size_t size) {
+  const size_t blocks = (size + blockSize - 1) / blockSize;
+
+  return sizeof(uint32_t) + blocks * sizeof(uint8_t) + ((size + 63) / 64 + blocks) * sizeof(uint64_t);
+}
+
+AlignedBuffer BooleanEncoder::encode(const uint8_t* values, size_t size) {
+  AlignedBuffer buffer;
+  buffer.write(static_cast<uint32_t>(size));
+
+  std::vector<uint64_t> words;
+  std::vector<uint64_t> runs;
+
+  for (size_t start = 0; start < size; start += blockSize) {
+    const size_t count = std::min(blockSize, size - start);
+    packBlock(values + start, count, words);
+
+    const size_t packedSize = words.size() * sizeof(uint64_t);
+
+    // Blocks with more runs than packed bytes are too noisy to be worth run length encoding
+    runs.clear();
+    if (collectRuns(words, count, packedSize, runs)) {
+      AlignedBuffer runsBuffer = Simple8B::encode(runs);
+
+      if (runsBuffer.size() + sizeof(uint8_t) + sizeof(uint32_t) < packedSize) {
+        buffer.write(static_cast<uint8_t>(RUN_LENGTH));
+        buffer.write(static_cast<uint8_t>(words[0] & 1));
+        buffer.write(static_cast<uint32_t>(runsBuffer.size()));
+        buffer.write(runsBuffer);
+        continue;
+      }
+    }
+
+    buffer.write(static_cast<uint8_t>(BITPACKED));
+
+    const size_t offset = buffer.data.size();
+    buffer.data.resize(offset + packedSize);
+    std::memcpy(buffer.data.data() + offset, words.data(), packedSize);
+  }
+
+  return buffer;
+}
+
+void BooleanEncoder::decode(Slice& encoded, uint8_t* out, uint32_t size) {
+  encoded.offset += sizeof(uint32_t);
+
+  for (size_t start = 0; start < size; start += blockSize) {
+    const size_t count = std::min<size_t>(blockSize, size - start);
+    uint8_t* block = out + start;
+
+    const uint8_t mode = encoded.read<uint8_t>();
+
+    if (mode == RUN_LENGTH) {
+      uint8_t value = encoded.read<uint8_t>() & 1;
+      const uint32_t runsLength = encoded.read<uint32_t>();
+
+      Slice runsSlice = encoded.getSlice(runsLength);
+
+      // Runs are unpacked a word at a time, so decoding does not allocate
+      uint64_t runs[Simple8B::maxPerWord];
+      size_t position = 0;
+
+      for (size_t word = 0, words = runsSlice.length<uint64_t>(); word < words; word++) {
+        const size_t unpacked = Simple8B::unpack(runsSlice.read<uint64_t>(), runs);
+
+        for (size_t r = 0; r < unpacked; r++) {
+          const size_t length = std::min<uint64_t>(runs[r], count - position);
+          std::memset(block + position, value, length);
+
+          position += length;
+          value ^= 1;
+        }
+      }
+
+      if (position != count) {
+        throw std::runtime_error("Invalid data format");
+      }
+
+      continue;
+    }
+
+    const size_t words = (count + 63) / 64;
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      const uint64_t bits = encoded.data[encoded.offset + i / 8];
+      const uint64_t bytes = unpack8(bits);
+      std::memcpy(block + i, &bytes, sizeof(bytes));
+    }
+
+    if (i < count) {
+      const uint64_t bytes = unpack8(encoded.data[encoded.offset + i / 8]);
+      std::memcpy(block + i, &bytes, count - i);
+    }
+
+    encoded.offset += words * sizeof(uint64_t);
+  }
+}
+
+bool BooleanEncoder::validate(const uint8_t* data, size_t length, uint32_t size) {
+  if (length < sizeof(uint32_t)) return false;
+
+  uint32_t encodedSize;
+  std::memcpy(&encodedSize, data, sizeof(uint32_t));
+
+  if (encodedSize < size) return false;
+
+  size_t offset = sizeof(uint32_t);
+
+  for (size_t start = 0; start < size; start += blockSize) {
+    const size_t count = std::min<size_t>(blockSize, size - start);
+
+    if (length - offset < sizeof(uint8_t)) return false;
+
+    const uint8_t mode = data[offset++];
+
+    if (mode == RUN_LENGTH) {
+      if (length - offset < sizeof(uint8_t) + sizeof(uint32_t)) return false;
+
+      uint32_t runsLength;
+      std::memcpy(&runsLength, data + offset + sizeof(uint8_t), sizeof(uint32_t));
+      offset += sizeof(uint8_t) + sizeof(uint32_t);
+
+      if (length - offset < runsLength) return false;
+
+      offset += runsLength;
+      continue;
+    }
+
+    const size_t words = (count + 63) / 64;
+
+    if (mode != BITPACKED || (length - offset) / sizeof(uint64_t) < words) return false;
+
+    offset += words * sizeof(uint64_t);
+  }
+
+  return true;
+}
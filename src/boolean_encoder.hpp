@@ -0,0 +1,36 @@
+#ifndef __BOOLEAN_ENCODER_H_INCLUDED__
+#define __BOOLEAN_ENCODER_H_INCLUDED__
+
+#include <cstdint>
+#include <vector>
+
+#include "aligned_buffer.hpp"
+#include "slice_buffer.hpp"
+
+class BooleanEncoder {
+ private:
+ public:
+  BooleanEncoder(){};
+
+  // Number of values per block, each block picks its own mode
+  static constexpr size_t blockSize = 65536;
+
+  enum BlockMode : uint8_t { BITPACKED = 0, RUN_LENGTH = 1 };
+
+  static AlignedBuffer encode(const uint8_t* values, size_t size);
+  static void decode(Slice& encoded, uint8_t* out, uint32_t size);
+
+  // Checks the block modes and lengths, false if data cannot hold size values.
+  // decode trusts data that passed and only checks the run lengths themselves
+  static bool validate(const uint8_t* data, size_t length, uint32_t size);
+
+  // Upper bound of the encoded size of size values
+  static size_t maxEncodedSize(size_t size);
+
+  // Packs 64 bytes of 0/1 into a word, least significant bit first
+  static uint64_t pack64(const uint8_t* values);
+  // Expands the low 8 bits of a word into 8 bytes of 0/1
+  static uint64_t unpack8(uint64_t bits);
+};
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef __BUFFER_HEADER_H_INCLUDED__
+#define __BUFFER_HEADER_H_INCLUDED__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum CompressionType : uint8_t {
+  INTEGER_ENCODER = 0,
+  FLOAT_ENCODER = 1,
+  BOOLEAN_ENCODER = 2,
+  STRING_ENCODER = 3,
+  STRING_DICTIONARY_ENCODER = 4,
+  STRING_FRONT_CODED_ENCODER = 5,
+  BOOLEAN_HYBRID_ENCODER = 6,
+  INTEGER_SCALED_ENCODER = 7,
+  FLOAT_RAW_ENCODER = 8,
+  FLOAT_SNAPPY_ENCODER = 9,
+  SNAPPY = 10,
+  MULTI_COLUMN_ENCODER = 11,
+  NULLABLE_ENCODER = 12,
+  FLOAT_ENTROPY_ENCODER = 14,
+  FLOAT_FPC_ENCODER = 15,
+  INTEGER_PFOR_ENCODER = 16,
+  FLOAT_SHUFFLE_ENCODER = 17,
+  FLOAT32_ENCODER = 18,
+  FLOAT_RUNS_ENCODER = 19,
+  FLOAT_INTEGER_ENCODER = 20
+};
+
+// Flags stored in the high bits of the leading timestamp type byte
+enum HeaderFlags : uint8_t { HEADER_TIME_BOUNDS = 0x80, HEADER_FLAGS_MASK = 0xc0 };
+
+// Layout:
+//   [uint8 timestamp type | flags][uint32 item count]
+//   ([uint64 min timestamp][uint64 max timestamp] when HEADER_TIME_BOUNDS is set)
+//   [uint32 timestamps byte length][timestamps][uint8 value type][values]
+class BufferHeader {
+ private:
+  template <class T>
+  static T load(const uint8_t* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+  }
+
+  template <class T>
+  static void store(uint8_t* data, T value) {
+    std::memcpy(data, &value, sizeof(T));
+  }
+
+ public:
+  uint8_t timestampType = INTEGER_ENCODER;
+  uint32_t itemCount = 0;
+
+  bool hasTimeBounds = false;
+  uint64_t minTimestamp = 0;
+  uint64_t maxTimestamp = 0;
+
+  size_t timestampsOffset = 0;
+  uint32_t timestampsLength = 0;
+
+  uint8_t valueType = 0;
+  size_t valuesOffset = 0;
+  size_t valuesLength = 0;
+
+  BufferHeader(){};
+
+  // Bytes written ahead of the timestamps section
+  size_t prefixSize() const {
+    return sizeof(uint8_t) + sizeof(uint32_t) + (hasTimeBounds ? 2 * sizeof(uint64_t) : 0) + sizeof(uint32_t);
+  }
+
+  // Writes everything up to the timestamps section into the start of out
+  void write(std::vector<uint8_t>& out) const {
+    if (out.size() < prefixSize()) out.resize(prefixSize());
+
+    uint8_t* data = out.data();
+
+    *data = timestampType | (hasTimeBounds ? HEADER_TIME_BOUNDS : 0);
+    data += sizeof(uint8_t);
+
+    store<uint32_t>(data, itemCount);
+    data += sizeof(uint32_t);
+
+    if (hasTimeBounds) {
+      store<uint64_t>(data, minTimestamp);
+      data += sizeof(uint64_t);
+      store<uint64_t>(data, maxTimestamp);
+      data += sizeof(uint64_t);
+    }
+
+    store<uint32_t>(data, timestampsLength);
+  }
+
+  // Parses the header without touching the encoded sections, false if the
+  // buffer is too short to hold what the header describes
+  bool read(const uint8_t* data, size_t length) {
+    if (length < sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t)) return false;
+
+    timestampType = data[0] & ~HEADER_FLAGS_MASK;
+    hasTimeBounds = (data[0] & HEADER_TIME_BOUNDS) != 0;
+
+    if (length < prefixSize()) return false;
+
+    size_t offset = sizeof(uint8_t);
+
+    itemCount = load<uint32_t>(data + offset);
+    offset += sizeof(uint32_t);
+
+    if (hasTimeBounds) {
+      minTimestamp = load<uint64_t>(data + offset);
+      offset += sizeof(uint64_t);
+      maxTimestamp = load<uint64_t>(data + offset);
+      offset += sizeof(uint64_t);
+    }
+
+    timestampsLength = load<uint32_t>(data + offset);
+    offset += sizeof(uint32_t);
+
+    timestampsOffset = offset;
+
+    if (length - offset <= timestampsLength) return false;
+    offset += timestampsLength;
+
+    valueType = data[offset];
+    offset += sizeof(uint8_t);
+
+    valuesOffset = offset;
+    valuesLength = length - offset;
+
+    return true;
+  }
+};
+
+// Columns sharing one timestamps section, stored as the values of a
+// MULTI_COLUMN_ENCODER buffer.
+//
+// Layout:
+//   [uint32 column count] ([uint32 name length][name][uint32 section length])...
+//   ([uint8 value type][values])... one section per column, in directory order
+class ColumnDirectory {
+ public:
+  struct Entry {
+    std::string name;
+    uint8_t valueType = 0;
+
+    // Position of the encoded values, relative to the start of the directory
+    size_t valuesOffset = 0;
+    size_t valuesLength = 0;
+  };
+
+  std::vector<Entry> columns;
+
+  // Appends the directory and the sections, each section starting with its value type
+  static void write(const std::vector<std::string>& names, const std::vector<std::vector<uint8_t>>& sections,
+                    std::vector<uint8_t>& out) {
+    const auto append = [&](uint32_t value) {
+      const size_t offset = out.size();
+      out.resize(offset + sizeof(uint32_t));
+      std::memcpy(out.data() + offset, &value, sizeof(uint32_t));
+    };
+
+    append(names.size());
+
+    for (size_t i = 0; i < names.size(); i++) {
+      append(names[i].size());
+      out.insert(out.end(), names[i].begin(), names[i].end());
+      append(sections[i].size());
+    }
+
+    for (const auto& section : sections) out.insert(out.end(), section.begin(), section.end());
+  }
+
+  // Reads the directory without touching the sections, false if the data is
+  // too short to hold what the directory describes
+  bool read(const uint8_t* data, size_t length) {
+    size_t offset = 0;
+
+    const auto load = [&](uint32_t& value) {
+      if (length - offset < sizeof(uint32_t)) return false;
+      std::memcpy(&value, data + offset, sizeof(uint32_t));
+      offset += sizeof(uint32_t);
+      return true;
+    };
+
+    uint32_t count;
+    if (!load(count)) return false;
+
+    std::vector<uint32_t> sectionLengths;
+
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t nameLength, sectionLength;
+      if (!load(nameLength) || length - offset < nameLength) return false;
+
+      Entry entry;
+      entry.name.assign(reinterpret_cast<const char*>(data + offset), nameLength);
+      offset += nameLength;
+
+      if (!load(sectionLength) || sectionLength == 0) return false;
+
+      columns.push_back(std::move(entry));
+      sectionLengths.push_back(sectionLength);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+      if (length - offset < sectionLengths[i]) return false;
+
+      columns[i].valueType = data[offset];
+      columns[i].valuesOffset = offset + sizeof(uint8_t);
+      columns[i].valuesLength = sectionLengths[i] - sizeof(uint8_t);
+
+      offset += sectionLengths[i];
+    }
+
+    return true;
+  }
+};
+
+#endif
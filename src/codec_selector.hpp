@@ -0,0 +1,94 @@
+#ifndef __CODEC_SELECTOR_H_INCLUDED__
+#define __CODEC_SELECTOR_H_INCLUDED__
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "aligned_buffer.hpp"
+#include "buffer_header.hpp"
+
+// A value codec that can be picked by the selector, encode appends the
+// encoded values (without the type byte) to out
+template <class T>
+struct Codec {
+  CompressionType type;
+  void (*encode)(const std::vector<T>& values, AlignedBuffer& out);
+};
+
+class CodecSelector {
+ private:
+  // The sample is taken as a few runs spread over the series, so codecs that
+  // depend on neighbouring values still see realistic input
+  static constexpr size_t sampleRuns = 4;
+
+ public:
+  static constexpr uint32_t defaultSampleSize = 1024;
+
+  template <class T>
+  static std::vector<T> sample(const std::vector<T>& values, uint32_t sampleSize) {
+    const size_t runLength = std::max<size_t>(sampleSize / sampleRuns, 1);
+    const size_t stride = values.size() / sampleRuns;
+
+    std::vector<T> out;
+    out.reserve(runLength * sampleRuns);
+
+    for (size_t run = 0; run < sampleRuns; run++) {
+      const auto start = values.begin() + run * stride;
+      out.insert(out.end(), start, start + runLength);
+    }
+
+    return out;
+  }
+
+  // Encodes values with the candidate whose encoding of a sample of at most
+  // sampleSize values is the smallest, and returns the type that was used.
+  // The first candidate is used without sampling when sampleSize is 0, and
+  // every candidate encodes the whole series when it fits in the sample
+  template <class T, size_t N>
+  static CompressionType encode(const std::vector<T>& values, uint32_t sampleSize, const Codec<T> (&candidates)[N],
+                                AlignedBuffer& out) {
+    if (sampleSize == 0 || N == 1) {
+      candidates[0].encode(values, out);
+      return candidates[0].type;
+    }
+
+    if (values.size() <= sampleSize) {
+      AlignedBuffer best;
+      size_t bestIndex = 0;
+
+      for (size_t i = 0; i < N; i++) {
+        AlignedBuffer encoded;
+        candidates[i].encode(values, encoded);
+
+        if (i == 0 || encoded.size() < best.size()) {
+          best.data.swap(encoded.data);
+          bestIndex = i;
+        }
+      }
+
+      out.data.insert(out.data.end(), best.data.begin(), best.data.end());
+      return candidates[bestIndex].type;
+    }
+
+    const std::vector<T> sampled = sample(values, sampleSize);
+
+    size_t bestIndex = 0;
+    size_t bestSize = SIZE_MAX;
+
+    for (size_t i = 0; i < N; i++) {
+      AlignedBuffer encoded;
+      candidates[i].encode(sampled, encoded);
+
+      if (encoded.size() < bestSize) {
+        bestSize = encoded.size();
+        bestIndex = i;
+      }
+    }
+
+    candidates[bestIndex].encode(values, out);
+    return candidates[bestIndex].type;
+  }
+};
+
+#endif
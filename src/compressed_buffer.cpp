@@ -148,12 +148,15 @@ bool CompressedBuffer::readBit() {
   return value;
 }
 
+template void CompressedBuffer::write<4>(uint64_t value);
 template void CompressedBuffer::write<6>(uint64_t value);
 template void CompressedBuffer::write<5>(uint64_t value);
 template void CompressedBuffer::write<8>(uint64_t value);
 template void CompressedBuffer::write<64>(uint64_t value);
 
+template void CompressedBuffer::writeFixed<0b00, 2>();
 template void CompressedBuffer::writeFixed<0b01, 2>();
+template void CompressedBuffer::writeFixed<0b10, 2>();
 template void CompressedBuffer::writeFixed<0b11, 2>();
 template void CompressedBuffer::writeFixed<0b0, 1>();
 
@@ -1,9 +1,317 @@
 #include "float_encoder.hpp"
+#include "bit_reader.hpp"
+#include "huffman.hpp"
+#include "integer_encoder.hpp"
+#include "stats.hpp"
 #include "util.hpp"
 
+#include <snappy.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+
+// Raw layout:
+//   [float64]... one per value
+//
+// Snappy layout:
+//   snappy compressed Gorilla words
+//
+// Entropy layout:
+//   [float64 first value][uint8 code length]... for the control, leading zero and data bit alphabets
+//   [uint32 control stream byte length][control stream words][data bit words]
+//   the control stream holds a Huffman coded control symbol per value after the
+//   first, followed by the leading zero and data bit symbols when it opens a new
+//   window. The data bits of every changed value are in the second stream
+//
+// FPC layout:
+//   [uint8 table size log2][uint8 header]... two 4 bit headers per byte, low nibble first
+//   [residual bytes]... the low 8 - n bytes of each XOR residual, n being its leading zero bytes
+//   a header is [1 bit DFCM predictor used][3 bit leading zero byte code], the
+//   code is n for n < 4 and n - 1 above, 4 leading zero bytes are coded as 3
+//
+// Float32 layout:
+//   Gorilla words over 32 bit values, the first value takes 32 bits and a new
+//   window is [11][4 bit leading zeros][5 bit length, 0 for 32]
+//
+// Shuffle layout:
+//   [uint8 SHUFFLE_PLANES or SHUFFLE_SNAPPY][8 byte planes, snappy compressed with SHUFFLE_SNAPPY]
+//   plane k holds byte k of every value, planes that snappy would not shrink are stored as they are
+//
+// Integers layout:
+//   the IntegerEncoder hybrid layout over the values as two's complement int64
+//
+// Runs layout:
+//   Gorilla words where a repeat is [00] for a single value or [10][varint count]
+//   for count + runMinLength values. The varint is 7 bits per byte, low group
+//   first, with the high bit set on every byte but the last
+
+namespace {
+
+// Control symbols of the entropy layout, the same three cases as Gorilla's 0, 01 and 11 codes
+enum EntropyControl : uint8_t { ENTROPY_SAME = 0, ENTROPY_REUSE = 1, ENTROPY_WINDOW = 2 };
+
+constexpr size_t entropyControls = 3;
+constexpr size_t entropyLeading = 32;
+constexpr size_t entropyDataBits = 64;
+constexpr size_t entropyLengthsSize = entropyControls + entropyLeading + entropyDataBits;
+
+enum ShuffleMode : uint8_t { SHUFFLE_PLANES = 0, SHUFFLE_SNAPPY = 1 };
+
+// A run code takes 2 bits and a varint byte, which single repeats only match below 5 values
+constexpr uint32_t runMinLength = 5;
+
+// Varint bytes of a run count, enough for any uint32 count
+constexpr int runMaxGroups = 5;
+
+// Transposes 8 rows of 8 bytes in three rounds of swapping bytes, pairs of
+// bytes and halves between rows. A byte matrix transposed twice is the same
+// matrix, so this both splits values into planes and joins them back
+inline void transpose8(uint64_t* rows) {
+  constexpr uint64_t masks[3] = {0x00ff00ff00ff00ffull, 0x0000ffff0000ffffull, 0x00000000ffffffffull};
+
+  loop<int, 3>([&](auto round) {
+    constexpr int distance = 1 << round;
+
+    loop<int, 4>([&](auto pair) {
+      constexpr int a = pair / distance * distance * 2 + pair % distance;
+      constexpr int b = a + distance;
+
+      const uint64_t swapped = ((rows[a] >> (8 * distance)) ^ rows[b]) & masks[round];
+      rows[b] ^= swapped;
+      rows[a] ^= swapped << (8 * distance);
+    });
+  });
+}
+
+#if defined(__SSE2__)
+// transpose8 on two matrices at once, one per 64 bit lane
+inline void transpose8(__m128i* rows) {
+  const __m128i masks[3] = {_mm_set1_epi64x(0x00ff00ff00ff00ffll), _mm_set1_epi64x(0x0000ffff0000ffffll),
+                            _mm_set1_epi64x(0x00000000ffffffffll)};
+
+  loop<int, 3>([&](auto round) {
+    constexpr int distance = 1 << round;
+
+    loop<int, 4>([&](auto pair) {
+      constexpr int a = pair / distance * distance * 2 + pair % distance;
+      constexpr int b = a + distance;
+
+      const __m128i swapped =
+          _mm_and_si128(_mm_xor_si128(_mm_srli_epi64(rows[a], 8 * distance), rows[b]), masks[round]);
+      rows[b] = _mm_xor_si128(rows[b], swapped);
+      rows[a] = _mm_xor_si128(rows[a], _mm_slli_epi64(swapped, 8 * distance));
+    });
+  });
+}
+#endif
+
+// Splits size values into eight planes of size bytes
+void shuffle(const uint8_t* values, size_t size, uint8_t* planes) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  // Values i to i + 7 go through the low lanes and i + 8 to i + 15 through the high ones
+  for (; i + 16 <= size; i += 16) {
+    __m128i rows[8];
+
+    for (int r = 0; r < 8; r++) {
+      rows[r] = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(values + (i + r) * 8)),
+                                   _mm_loadl_epi64(reinterpret_cast<const __m128i*>(values + (i + 8 + r) * 8)));
+    }
+
+    transpose8(rows);
+
+    for (int k = 0; k < 8; k++) _mm_storeu_si128(reinterpret_cast<__m128i*>(planes + k * size + i), rows[k]);
+  }
+#endif
+
+  for (; i + 8 <= size; i += 8) {
+    uint64_t rows[8];
+    std::memcpy(rows, values + i * 8, sizeof(rows));
+
+    transpose8(rows);
+
+    for (int k = 0; k < 8; k++) std::memcpy(planes + k * size + i, &rows[k], sizeof(uint64_t));
+  }
+
+  for (; i < size; i++) {
+    for (int k = 0; k < 8; k++) planes[k * size + i] = values[i * 8 + k];
+  }
+}
+
+// Joins eight planes of size bytes back into size values
+void unshuffle(const uint8_t* planes, size_t size, uint8_t* values) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 16 <= size; i += 16) {
+    __m128i rows[8];
+
+    for (int k = 0; k < 8; k++) rows[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + k * size + i));
+
+    transpose8(rows);
+
+    for (int r = 0; r < 8; r++) {
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(values + (i + r) * 8), rows[r]);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(values + (i + 8 + r) * 8), _mm_unpackhi_epi64(rows[r], rows[r]));
+    }
+  }
+#endif
+
+  for (; i + 8 <= size; i += 8) {
+    uint64_t rows[8];
+    for (int k = 0; k < 8; k++) std::memcpy(&rows[k], planes + k * size + i, sizeof(uint64_t));
+
+    transpose8(rows);
+
+    std::memcpy(values + i * 8, rows, sizeof(rows));
+  }
+
+  for (; i < size; i++) {
+    for (int k = 0; k < 8; k++) values[i * 8 + k] = planes[k * size + i];
+  }
+}
+
+// Converts int64 values within the safe integer range to doubles. SSE2 has no
+// 64 bit integer conversion, so each value is split into 32 bit halves, which
+// are exact in the mantissa of a double offset by 2^52 and joined back exactly.
+// in and out may be the same memory, each value is read before it is written
+void integersToDoubles(const uint64_t* in, size_t size, double* out) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128d lowOffset = _mm_set1_pd(4503599627370496.0);
+  const __m128d highOffset = _mm_set1_pd(4503599627370496.0 + 2147483648.0);
+  const __m128d highScale = _mm_set1_pd(4294967296.0);
+  const __m128i exponent = _mm_castpd_si128(lowOffset);
+  const __m128i lowMask = _mm_set1_epi64x(0xffffffffll);
+  const __m128i highSign = _mm_set1_epi64x(0x80000000ll);
+
+  for (; i + 2 <= size; i += 2) {
+    const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+    // The signed high half is made unsigned by adding 2^31, which its offset takes back off
+    const __m128i high = _mm_xor_si128(_mm_srli_epi64(value, 32), highSign);
+    const __m128i low = _mm_and_si128(value, lowMask);
+
+    const __m128d highDouble = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(high, exponent)), highOffset);
+    const __m128d lowDouble = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(low, exponent)), lowOffset);
+
+    _mm_storeu_pd(out + i, _mm_add_pd(_mm_mul_pd(highDouble, highScale), lowDouble));
+  }
+#endif
+
+  for (; i < size; i++) {
+    uint64_t value;
+    std::memcpy(&value, in + i, sizeof(value));
+
+    const double converted = static_cast<double>(static_cast<int64_t>(value));
+    std::memcpy(out + i, &converted, sizeof(converted));
+  }
+}
+
+// FPC tables grow with the series up to 2^16 entries, so short series do not pay for clearing large tables
+constexpr int fpcMinTableBits = 6;
+constexpr int fpcMaxTableBits = 16;
+
+// Both predictors of FPC, which the encoder and the decoder update with the same values
+class FpcPredictor {
+ private:
+  std::vector<uint64_t> fcm;
+  std::vector<uint64_t> dfcm;
+  uint64_t mask;
+  uint64_t fcmHash = 0;
+  uint64_t dfcmHash = 0;
+  uint64_t last = 0;
+
+ public:
+  explicit FpcPredictor(int tableBits)
+      : fcm(size_t(1) << tableBits), dfcm(size_t(1) << tableBits), mask((uint64_t(1) << tableBits) - 1) {}
+
+  uint64_t fcmPrediction() const { return fcm[fcmHash]; }
+  uint64_t dfcmPrediction() const { return dfcm[dfcmHash] + last; }
+
+  void update(uint64_t value) {
+    const uint64_t delta = value - last;
+
+    fcm[fcmHash] = value;
+    fcmHash = ((fcmHash << 6) ^ (value >> 48)) & mask;
+
+    dfcm[dfcmHash] = delta;
+    dfcmHash = ((dfcmHash << 2) ^ (delta >> 40)) & mask;
+
+    last = value;
+  }
+};
+
+// Reads a stream of Gorilla words, unchecked reads are used while the stream
+// has enough words left
+class GorillaReader {
+ private:
+  BitReader reader;
+
+  uint64_t value = 0;
+  int tzb = 0;
+  int dataBits = 64;
+
+ public:
+  // Most bits a value other than the first takes
+  static constexpr size_t maxValueBits = 2 + 5 + 6 + 64;
+
+  GorillaReader(const uint8_t* data, size_t length) : reader(data, length) {}
+
+  bool overran() const { return reader.overran(); }
+
+  // How many more values can be read without checking for the end of the stream
+  size_t uncheckedValues() const {
+    const size_t bits = reader.uncheckedBits();
+    return bits > maxValueBits ? (bits - maxValueBits) / maxValueBits : 0;
+  }
+
+  double first() {
+    value = reader.read(64);
+
+    double decoded;
+    std::memcpy(&decoded, &value, sizeof(decoded));
+    return decoded;
+  }
+
+  template <bool checked>
+  double next() {
+    const uint64_t control = reader.peek<checked>();
+
+    if (control & 1) {
+      if (control & 2) {
+        const int lzb = (control >> 2) & 31;
+        const int headerBits = (control >> 7) & 63;
+
+        dataBits = headerBits == 0 ? 64 : headerBits;
+        tzb = (64 - lzb - dataBits) & 63;
+        reader.skip(13);
+      } else {
+        reader.skip(2);
+      }
+
+      value ^= reader.read<checked>(dataBits) << tzb;
+    } else {
+      reader.skip(1);
+    }
+
+    double decoded;
+    std::memcpy(&decoded, &value, sizeof(decoded));
+    return decoded;
+  }
+};
+
+}  // namespace
 
 CompressedBuffer FloatEncoder::encode(const std::vector<double>& values) {
   CompressedBuffer buffer;
@@ -49,35 +357,803 @@ CompressedBuffer FloatEncoder::encode(const std::vector<double>& values) {
   return buffer;
 }
 
-void FloatEncoder::decode(CompressedSlice& values, std::vector<double>& out, uint32_t size) {
-  uint64_t last_value = values.readFixed<uint64_t, 64>();
-  int tzb = 0;
+void FloatEncoder::decode(Slice& values, std::vector<double>& out, uint32_t size) {
+  const size_t begin = out.size();
+
+  out.resize(begin + size);
+  out.resize(begin + decode(values, out.data() + begin, size));
+}
+
+uint32_t FloatEncoder::decode(Slice& values, double* out, uint32_t size) {
+  if (size == 0) return 0;
+
+  GorillaReader reader(values.data + values.offset, values.bytesLeft());
+  values.offset = values.length_;
+
+  out[0] = reader.first();
+  uint32_t i = 1;
+
+  // Reads are unchecked while the stream has words enough for the widest value
+  while (i < size) {
+    const size_t unchecked = std::min<size_t>(size - i, reader.uncheckedValues());
+    if (unchecked == 0) break;
+
+    for (const uint32_t end = i + unchecked; i < end; i++) out[i] = reader.next<false>();
+  }
+
+  for (; i < size; i++) out[i] = reader.next<true>();
+
+  if (reader.overran()) throw std::runtime_error("Invalid data format");
+  return size;
+}
+
+size_t FloatEncoder::maxEncodedSize(size_t size) {
+  // The first value takes 64 bits, the others at most a 13 bit control block and 64 data bits.
+  // Runs stay under this bound, a repeat or a run of them never takes more than a changed value
+  const size_t bits = 64 + (size > 0 ? size - 1 : 0) * (2 + 5 + 6 + 64);
+  const size_t gorillaBytes = (bits / 64 + 1) * sizeof(uint64_t);
+
+  // Entropy codes take up to three codes of maxLength bits in place of the 13 bit control block
+  const size_t entropyBits = (size > 0 ? size - 1 : 0) * (3 * HuffmanCode::maxLength + 64);
+  const size_t entropyBytes = sizeof(uint64_t) + entropyLengthsSize + sizeof(uint32_t) + (entropyBits / 64 + 2) * sizeof(uint64_t);
+
+  // FPC adds a 4 bit header to every value
+  const size_t fpcBytes = sizeof(uint8_t) + (size + 1) / 2 + size * sizeof(double);
+
+  // Shuffled planes are stored as they are when snappy does not shrink them
+  const size_t shuffleBytes = sizeof(uint8_t) + size * sizeof(double);
+
+  return std::max({snappy::MaxCompressedLength(gorillaBytes), size * sizeof(double), entropyBytes, fpcBytes,
+                   shuffleBytes});
+}
+
+void FloatEncoder::encode(const std::vector<double>& values, AlignedBuffer& out) {
+  CompressedBuffer buffer = encode(values);
+  out.write(buffer);
+}
+
+void FloatEncoder::encodeRaw(const std::vector<double>& values, AlignedBuffer& out) {
+  const size_t offset = out.data.size();
+
+  out.data.resize(offset + values.size() * sizeof(double));
+  std::memcpy(out.data.data() + offset, values.data(), values.size() * sizeof(double));
+}
+
+void FloatEncoder::decodeRaw(Slice& values, std::vector<double>& out, uint32_t size) {
+  const size_t offset = out.size();
+
+  out.resize(offset + size);
+  decodeRaw(values, out.data() + offset, size);
+}
+
+uint32_t FloatEncoder::decodeRaw(Slice& values, double* out, uint32_t size) {
+  if (values.bytesLeft() < size * sizeof(double)) {
+    throw std::runtime_error("Invalid data format");
+  }
+
+  std::memcpy(out, values.data + values.offset, size * sizeof(double));
+  values.offset += size * sizeof(double);
+
+  return size;
+}
+
+void FloatEncoder::encodeSnappy(const std::vector<double>& values, AlignedBuffer& out) {
+  CompressedBuffer buffer = encode(values);
+
+  StageTimer snappyTimer(STAGE_SNAPPY, values.size(), buffer.dataByteSize());
+
+  std::string compressed;
+  snappy::Compress(reinterpret_cast<const char*>(buffer.data.data()), buffer.dataByteSize(), &compressed);
+
+  snappyTimer.stop();
+
+  out.write(compressed);
+}
+
+void FloatEncoder::decodeSnappy(Slice& values, std::vector<double>& out, uint32_t size) {
+  const size_t begin = out.size();
+
+  out.resize(begin + size);
+  out.resize(begin + decodeSnappy(values, out.data() + begin, size));
+}
+
+uint32_t FloatEncoder::decodeSnappy(Slice& values, double* out, uint32_t size) {
+  StageTimer snappyTimer(STAGE_SNAPPY, size, values.bytesLeft());
+
+  std::string words;
+  if (!snappy::Uncompress(reinterpret_cast<const char*>(values.data + values.offset), values.bytesLeft(), &words)) {
+    throw std::runtime_error("Invalid data format");
+  }
+
+  values.offset = values.length_;
+  snappyTimer.stop();
+
+  Slice slice(reinterpret_cast<const uint8_t*>(words.data()), words.size());
+  return decode(slice, out, size);
+}
+
+void FloatEncoder::encodeEntropy(const std::vector<double>& values, AlignedBuffer& out) {
+  if (values.empty()) return;
+
+  // The same choices as encode, kept as symbols until the codes are known
+  std::vector<uint8_t> symbols;
+  std::vector<uint64_t> controlCounts(entropyControls), leadingCounts(entropyLeading), dataBitCounts(entropyDataBits);
+  CompressedBuffer payload;
+
+  uint64_t last_value = getUint64Representation(values[0]);
   int data_bits = 0;
-  double value;
+  int prev_lzb = -1;
+  int prev_tzb = -1;
+
+  symbols.reserve(values.size());
+
+  for (size_t i = 1; i < values.size(); i++) {
+    const uint64_t current_value = getUint64Representation(values[i]);
+    const uint64_t xor_value = current_value ^ last_value;
+
+    if (xor_value == 0) {
+      symbols.push_back(ENTROPY_SAME);
+      controlCounts[ENTROPY_SAME]++;
+    } else {
+      int lzb = getLeadingZeroBits(xor_value);
+      const int tzb = getTrailingZeroBits(xor_value);
+
+      if (data_bits != 0 && prev_lzb <= lzb && prev_tzb <= tzb) {
+        symbols.push_back(ENTROPY_REUSE);
+        controlCounts[ENTROPY_REUSE]++;
+      } else {
+        if (lzb > 31) lzb = 31;
+
+        data_bits = 8 * sizeof(uint64_t) - lzb - tzb;
+
+        const uint8_t dataBitSymbol = data_bits != 64 ? data_bits : 0;
+
+        symbols.push_back(ENTROPY_WINDOW);
+        symbols.push_back(lzb);
+        symbols.push_back(dataBitSymbol);
+
+        controlCounts[ENTROPY_WINDOW]++;
+        leadingCounts[lzb]++;
+        dataBitCounts[dataBitSymbol]++;
 
-  value = getDoubleRepresentation(last_value);
-  out.push_back(value);
+        prev_lzb = lzb;
+        prev_tzb = tzb;
+      }
+
+      payload.write(xor_value >> prev_tzb, data_bits);
+    }
+
+    last_value = current_value;
+  }
+
+  const std::vector<uint8_t> controlLengths = HuffmanCode::lengths(controlCounts);
+  const std::vector<uint8_t> leadingLengths = HuffmanCode::lengths(leadingCounts);
+  const std::vector<uint8_t> dataBitLengths = HuffmanCode::lengths(dataBitCounts);
+
+  const HuffmanCode controlCode(controlLengths), leadingCode(leadingLengths), dataBitCode(dataBitLengths);
+
+  CompressedBuffer controls;
+
+  for (size_t i = 0; i < symbols.size(); i++) {
+    controlCode.write(controls, symbols[i]);
+
+    if (symbols[i] == ENTROPY_WINDOW) {
+      leadingCode.write(controls, symbols[++i]);
+      dataBitCode.write(controls, symbols[++i]);
+    }
+  }
+
+  out.write(getUint64Representation(values[0]));
+  for (uint8_t length : controlLengths) out.write(length);
+  for (uint8_t length : leadingLengths) out.write(length);
+  for (uint8_t length : dataBitLengths) out.write(length);
+
+  out.write(static_cast<uint32_t>(controls.dataByteSize()));
+  out.write(controls);
+  out.write(payload);
+}
+
+void FloatEncoder::decodeEntropy(Slice& values, std::vector<double>& out, uint32_t size) {
+  const size_t begin = out.size();
+
+  out.resize(begin + size);
+  decodeEntropy(values, out.data() + begin, size);
+}
+
+uint32_t FloatEncoder::decodeEntropy(Slice& values, double* out, uint32_t size) {
+  if (size == 0) return 0;
+
+  if (values.bytesLeft() < sizeof(uint64_t) + entropyLengthsSize + sizeof(uint32_t)) {
+    throw std::runtime_error("Invalid data format");
+  }
+
+  uint64_t value = values.read<uint64_t>();
+
+  const uint8_t* lengths = values.data + values.offset;
+  values.offset += entropyLengthsSize;
+
+  const HuffmanCode controlCode({lengths, lengths + entropyControls});
+  const HuffmanCode leadingCode({lengths + entropyControls, lengths + entropyControls + entropyLeading});
+  const HuffmanCode dataBitCode({lengths + entropyControls + entropyLeading, lengths + entropyLengthsSize});
 
-  while (!values.isAtEnd() && out.size() < size) {
-    if (values.readBit()) {
-      if (values.readBit()) {
-        const int lzb = values.readFixed<uint64_t, 5>();
-        data_bits = values.readFixed<uint64_t, 6>();
+  const uint32_t controlLength = values.read<uint32_t>();
+  if (values.bytesLeft() < controlLength) throw std::runtime_error("Invalid data format");
 
-        if (data_bits == 0) {
-          data_bits = 64;
+  BitReader controls(values.data + values.offset, controlLength);
+  BitReader payload(values.data + values.offset + controlLength, values.bytesLeft() - controlLength);
+  values.offset = values.length_;
+
+  int tzb = 0;
+  int dataBits = 64;
+
+  const auto next = [&](auto checked) {
+    const uint16_t control = controlCode.read<checked>(controls);
+
+    if (control != ENTROPY_SAME) {
+      if (control == ENTROPY_WINDOW) {
+        const int lzb = leadingCode.read<checked>(controls);
+        const int headerBits = dataBitCode.read<checked>(controls);
+
+        dataBits = headerBits == 0 ? 64 : headerBits;
+        tzb = (64 - lzb - dataBits) & 63;
+      }
+
+      value ^= payload.read<checked>(dataBits) << tzb;
+    }
+
+    double decoded;
+    std::memcpy(&decoded, &value, sizeof(decoded));
+    return decoded;
+  };
+
+  out[0] = getDoubleRepresentation(value);
+
+  // Control reads are unchecked for as many values as the stream certainly holds
+  constexpr size_t maxControlBits = 3 * HuffmanCode::maxLength;
+  uint32_t i = 1;
+
+  // The codes are read from a window of the control stream that is only
+  // reloaded once a value's codes might not fit, so each code is a shift and
+  // a table lookup rather than a word load followed by a table lookup
+  //
+  // When repeats are common enough for a one bit code, a run of them is a run
+  // of equal bits and is decoded at once
+  const bool sameRuns = controlCode.length(ENTROPY_SAME) == 1;
+  const uint64_t sameFill = controlCode.code(ENTROPY_SAME) ? ~uint64_t(0) : 0;
+
+  const auto decodeRun = [&](const uint32_t end, auto checkedPayload) {
+    uint64_t window = controls.peek<false>();
+    int used = 0;
+
+    while (i < end) {
+      if (used > 64 - static_cast<int>(maxControlBits)) {
+        controls.skip(used);
+        window = controls.peek<false>();
+        used = 0;
+      }
+
+      if (sameRuns) {
+        const uint32_t run = std::min({static_cast<uint32_t>(getTrailingZeroBits((window >> used) ^ sameFill)),
+                                       static_cast<uint32_t>(64 - used), end - i});
+
+        if (run > 0) {
+          std::fill(out + i, out + i + run, getDoubleRepresentation(value));
+          i += run;
+          used += run;
+          continue;
         }
+      }
+
+      const HuffmanCode::Entry& control = controlCode.lookup(window >> used);
+      used += control.length;
+
+      if (control.symbol != ENTROPY_SAME) {
+        if (control.symbol == ENTROPY_WINDOW) {
+          const HuffmanCode::Entry& lzb = leadingCode.lookup(window >> used);
+          used += lzb.length;
+
+          const HuffmanCode::Entry& headerBits = dataBitCode.lookup(window >> used);
+          used += headerBits.length;
+
+          dataBits = headerBits.symbol == 0 ? 64 : headerBits.symbol;
+          tzb = (64 - lzb.symbol - dataBits) & 63;
+        }
+
+        value ^= payload.read<checkedPayload>(dataBits) << tzb;
+      }
+
+      std::memcpy(out + i++, &value, sizeof(value));
+    }
+
+    controls.skip(used);
+  };
+
+  while (i < size) {
+    const size_t unchecked = std::min(size_t(size - i), controls.uncheckedBits() / maxControlBits);
+    if (unchecked == 0) break;
+
+    // Mostly repeated values leave a payload too short for unchecked reads,
+    // and they read it so rarely that checking those reads costs nothing
+    const size_t payloadUnchecked = payload.uncheckedBits() / 64;
+
+    if (payloadUnchecked == 0) {
+      decodeRun(i + unchecked, std::true_type{});
+    } else {
+      decodeRun(i + std::min(unchecked, payloadUnchecked), std::false_type{});
+    }
+  }
+
+  for (; i < size; i++) out[i] = next(std::true_type{});
+
+  if (controls.overran() || payload.overran()) throw std::runtime_error("Invalid data format");
+  return size;
+}
+
+void FloatEncoder::encodeFpc(const std::vector<double>& values, AlignedBuffer& out) {
+  int tableBits = fpcMinTableBits;
+  while (tableBits < fpcMaxTableBits && (size_t(1) << tableBits) < values.size()) tableBits++;
+
+  FpcPredictor predictor(tableBits);
+
+  std::vector<uint8_t> headers((values.size() + 1) / 2);
+  std::vector<uint8_t> residuals(values.size() * sizeof(uint64_t));
+  size_t residualLength = 0;
+
+  for (size_t i = 0; i < values.size(); i++) {
+    const uint64_t value = getUint64Representation(values[i]);
+    const uint64_t fcmResidual = value ^ predictor.fcmPrediction();
+    const uint64_t dfcmResidual = value ^ predictor.dfcmPrediction();
+
+    // The smaller residual has at least as many leading zero bytes
+    const bool useDfcm = dfcmResidual < fcmResidual;
+    const uint64_t residual = useDfcm ? dfcmResidual : fcmResidual;
+
+    int zeroBytes = getLeadingZeroBits(residual) / 8;
+    if (zeroBytes == 4) zeroBytes = 3;
+
+    const uint8_t header = (useDfcm << 3) | (zeroBytes > 4 ? zeroBytes - 1 : zeroBytes);
+    headers[i / 2] |= header << (i % 2 * 4);
+
+    std::memcpy(residuals.data() + residualLength, &residual, sizeof(residual));
+    residualLength += sizeof(uint64_t) - zeroBytes;
+
+    predictor.update(value);
+  }
+
+  const size_t offset = out.data.size();
+  out.data.resize(offset + sizeof(uint8_t) + headers.size() + residualLength);
+
+  uint8_t* target = out.data.data() + offset;
+  *target++ = tableBits;
+
+  std::memcpy(target, headers.data(), headers.size());
+  std::memcpy(target + headers.size(), residuals.data(), residualLength);
+}
+
+void FloatEncoder::decodeFpc(Slice& values, std::vector<double>& out, uint32_t size) {
+  const size_t begin = out.size();
+
+  out.resize(begin + size);
+  decodeFpc(values, out.data() + begin, size);
+}
+
+uint32_t FloatEncoder::decodeFpc(Slice& values, double* out, uint32_t size) {
+  const size_t headerLength = (size_t(size) + 1) / 2;
+
+  if (values.bytesLeft() < sizeof(uint8_t) + headerLength) throw std::runtime_error("Invalid data format");
+
+  const int tableBits = values.read<uint8_t>();
+  if (tableBits < fpcMinTableBits || tableBits > fpcMaxTableBits) throw std::runtime_error("Invalid data format");
+
+  const uint8_t* headers = values.data + values.offset;
+  const uint8_t* residuals = headers + headerLength;
+  const size_t residualLength = values.bytesLeft() - headerLength;
+  values.offset = values.length_;
+
+  FpcPredictor predictor(tableBits);
+  size_t position = 0;
+
+  for (uint32_t i = 0; i < size; i++) {
+    const uint8_t header = headers[i / 2] >> (i % 2 * 4);
+    const int code = header & 7;
+    const size_t length = sizeof(uint64_t) - (code > 3 ? code + 1 : code);
+
+    if (residualLength - position < length) throw std::runtime_error("Invalid data format");
+
+    // Whole words are loaded and masked while the residuals have room for them
+    uint64_t residual = 0;
+
+    if (residualLength - position >= sizeof(uint64_t)) {
+      std::memcpy(&residual, residuals + position, sizeof(residual));
+      if (length < sizeof(uint64_t)) residual &= (uint64_t(1) << (length * 8)) - 1;
+    } else {
+      std::memcpy(&residual, residuals + position, length);
+    }
+
+    position += length;
+
+    const uint64_t value = residual ^ (header & 8 ? predictor.dfcmPrediction() : predictor.fcmPrediction());
+    predictor.update(value);
+
+    std::memcpy(out + i, &value, sizeof(value));
+  }
+
+  return size;
+}
+
+void FloatEncoder::encodeShuffle(const std::vector<double>& values, AlignedBuffer& out) {
+  const size_t length = values.size() * sizeof(double);
+
+  std::vector<uint8_t> planes(length);
+  shuffle(reinterpret_cast<const uint8_t*>(values.data()), values.size(), planes.data());
+
+  StageTimer snappyTimer(STAGE_SNAPPY, values.size(), length);
+
+  std::string compressed;
+  snappy::Compress(reinterpret_cast<const char*>(planes.data()), length, &compressed);
+
+  snappyTimer.stop();
+
+  if (compressed.size() < length) {
+    out.write<uint8_t>(SHUFFLE_SNAPPY);
+    out.write(compressed);
+  } else {
+    out.write<uint8_t>(SHUFFLE_PLANES);
+    out.data.insert(out.data.end(), planes.begin(), planes.end());
+  }
+}
+
+void FloatEncoder::decodeShuffle(Slice& values, std::vector<double>& out, uint32_t size) {
+  const size_t begin = out.size();
 
-        tzb = 64 - lzb - data_bits;
+  out.resize(begin + size);
+  decodeShuffle(values, out.data() + begin, size);
+}
+
+uint32_t FloatEncoder::decodeShuffle(Slice& values, double* out, uint32_t size) {
+  const size_t length = size_t(size) * sizeof(double);
+
+  if (values.bytesLeft() < sizeof(uint8_t)) throw std::runtime_error("Invalid data format");
+
+  const uint8_t mode = values.read<uint8_t>();
+  const char* data = reinterpret_cast<const char*>(values.data + values.offset);
+  const size_t dataLength = values.bytesLeft();
+
+  values.offset = values.length_;
+
+  if (mode == SHUFFLE_PLANES) {
+    if (dataLength < length) throw std::runtime_error("Invalid data format");
+
+    unshuffle(reinterpret_cast<const uint8_t*>(data), size, reinterpret_cast<uint8_t*>(out));
+    return size;
+  }
+
+  StageTimer snappyTimer(STAGE_SNAPPY, size, dataLength);
+
+  // Reused by later decodes on the thread, so decodeInto does not allocate once it has grown
+  thread_local std::vector<uint8_t> planes;
+  size_t planesLength;
+
+  if (mode != SHUFFLE_SNAPPY || !snappy::GetUncompressedLength(data, dataLength, &planesLength) ||
+      planesLength != length) {
+    throw std::runtime_error("Invalid data format");
+  }
+
+  planes.resize(length);
+
+  if (!snappy::RawUncompress(data, dataLength, reinterpret_cast<char*>(planes.data()))) {
+    throw std::runtime_error("Invalid data format");
+  }
+
+  snappyTimer.stop();
+
+  unshuffle(planes.data(), size, reinterpret_cast<uint8_t*>(out));
+  return size;
+}
+
+void FloatEncoder::encodeRuns(const std::vector<double>& values, AlignedBuffer& out) {
+  if (values.empty()) return;
+
+  CompressedBuffer buffer;
+
+  uint64_t last_value = getUint64Representation(values[0]);
+  int data_bits = 0;
+  int prev_lzb = -1;
+  int prev_tzb = -1;
+
+  buffer.write(last_value, 64);
+
+  for (size_t i = 1; i < values.size();) {
+    const uint64_t current_value = getUint64Representation(values[i]);
+    const uint64_t xor_value = current_value ^ last_value;
+
+    if (xor_value == 0) {
+      size_t run = 1;
+      while (i + run < values.size() && getUint64Representation(values[i + run]) == last_value) run++;
+
+      i += run;
+
+      if (run < runMinLength) {
+        for (size_t j = 0; j < run; j++) buffer.writeFixed<0b00, 2>();
+        continue;
       }
 
-      const uint64_t decoded_value = values.read<uint64_t>(data_bits) << tzb;
-      last_value = last_value ^ decoded_value;
+      buffer.writeFixed<0b10, 2>();
+
+      uint64_t count = run - runMinLength;
+
+      do {
+        const uint64_t group = count & 0x7f;
+        count >>= 7;
+
+        buffer.write<8>(count != 0 ? group | 0x80 : group);
+      } while (count != 0);
+
+      continue;
+    }
+
+    int lzb = getLeadingZeroBits(xor_value);
+    const int tzb = getTrailingZeroBits(xor_value);
+
+    if (data_bits != 0 && prev_lzb <= lzb && prev_tzb <= tzb) {
+      buffer.writeFixed<0b01, 2>();
+    } else {
+      if (lzb > 31) lzb = 31;
+
+      data_bits = 8 * sizeof(uint64_t) - lzb - tzb;
+
+      buffer.writeFixed<0b11, 2>();
+      buffer.write<5>(lzb);
+      buffer.write<6>(data_bits != 64 ? data_bits : 0);
+
+      prev_lzb = lzb;
+      prev_tzb = tzb;
     }
 
-    value = getDoubleRepresentation(last_value);
-    out.push_back(value);
+    buffer.write(xor_value >> prev_tzb, data_bits);
+
+    last_value = current_value;
+    i++;
   }
+
+  out.write(buffer);
+}
+
+void FloatEncoder::decodeRuns(Slice& values, std::vector<double>& out, uint32_t size) {
+  const size_t begin = out.size();
+
+  out.resize(begin + size);
+  out.resize(begin + decodeRuns(values, out.data() + begin, size));
+}
+
+uint32_t FloatEncoder::decodeRuns(Slice& values, double* out, uint32_t size) {
+  if (size == 0) return 0;
+
+  BitReader reader(values.data + values.offset, values.bytesLeft());
+  values.offset = values.length_;
+
+  uint64_t value = reader.read(64);
+  int tzb = 0;
+  int dataBits = 64;
+  uint32_t i = 1;
+
+  std::memcpy(out, &value, sizeof(value));
+
+  // Decodes one control block into out + i and returns how many values it filled
+  const auto next = [&](auto checked) -> uint32_t {
+    const uint64_t control = reader.peek<checked>();
+
+    if (control & 1) {
+      if (control & 2) {
+        const int lzb = (control >> 2) & 31;
+        const int headerBits = (control >> 7) & 63;
+
+        dataBits = headerBits == 0 ? 64 : headerBits;
+        tzb = (64 - lzb - dataBits) & 63;
+        reader.skip(13);
+      } else {
+        reader.skip(2);
+      }
+
+      value ^= reader.read<checked>(dataBits) << tzb;
+    } else if (control & 2) {
+      // The whole varint is within the peeked word, 2 + 8 * runMaxGroups bits at most
+      uint64_t count = 0;
+      int group = 0;
+
+      for (;; group++) {
+        if (group == runMaxGroups) throw std::runtime_error("Invalid data format");
+
+        const uint64_t byte = (control >> (2 + 8 * group)) & 0xff;
+        count |= (byte & 0x7f) << (7 * group);
+
+        if ((byte & 0x80) == 0) break;
+      }
+
+      reader.skip(2 + 8 * (group + 1));
+
+      const uint32_t filled = static_cast<uint32_t>(std::min<uint64_t>(count + runMinLength, size - i));
+
+      double decoded;
+      std::memcpy(&decoded, &value, sizeof(decoded));
+      std::fill(out + i, out + i + filled, decoded);
+
+      return filled;
+    } else {
+      reader.skip(2);
+    }
+
+    std::memcpy(out + i, &value, sizeof(value));
+    return 1;
+  };
+
+  // A control block takes at most 13 + 64 bits, however many values it fills
+  constexpr size_t maxBlockBits = 77;
+
+  while (i < size) {
+    size_t blocks = reader.uncheckedBits() / maxBlockBits;
+    if (blocks == 0) break;
+
+    for (; blocks > 0 && i < size; blocks--) i += next(std::false_type{});
+  }
+
+  while (i < size) i += next(std::true_type{});
+
+  if (reader.overran()) throw std::runtime_error("Invalid data format");
+  return size;
+}
+
+bool FloatEncoder::isIntegral(const std::vector<double>& values) {
+  constexpr double maxSafeInteger = 9007199254740991.0;
+
+  for (double value : values) {
+    // NaN fails the range check
+    if (!(std::abs(value) <= maxSafeInteger) || std::trunc(value) != value) return false;
+    if (value == 0 && std::signbit(value)) return false;
+  }
+
+  return true;
+}
+
+void FloatEncoder::encodeIntegers(const std::vector<double>& values, AlignedBuffer& out) {
+  std::vector<uint64_t> integers(values.size());
+
+  for (size_t i = 0; i < values.size(); i++) integers[i] = static_cast<int64_t>(values[i]);
+
+  AlignedBuffer encoded = IntegerEncoder::encodeHybrid(integers, IntegerEncoder::commonDivisor(integers));
+  out.write(encoded);
+}
+
+void FloatEncoder::decodeIntegers(Slice& values, std::vector<double>& out, uint32_t size) {
+  const size_t begin = out.size();
+
+  out.resize(begin + size);
+  out.resize(begin + decodeIntegers(values, out.data() + begin, size));
+}
+
+uint32_t FloatEncoder::decodeIntegers(Slice& values, double* out, uint32_t size) {
+  // The integers are decoded into out and converted in place, both are 8 bytes
+  uint64_t* integers = reinterpret_cast<uint64_t*>(out);
+  const size_t count = IntegerEncoder::decodeHybrid(values, integers, size);
+
+  integersToDoubles(integers, count, out);
+  return count;
+}
+
+void FloatEncoder::encode32(const std::vector<float>& values, AlignedBuffer& out) {
+  if (values.empty()) return;
+
+  CompressedBuffer buffer;
+
+  uint32_t last_value;
+  std::memcpy(&last_value, &values[0], sizeof(last_value));
+
+  int data_bits = 0;
+  int prev_lzb = -1;
+  int prev_tzb = -1;
+
+  buffer.write(last_value, 32);
+
+  for (size_t i = 1; i < values.size(); i++) {
+    uint32_t current_value;
+    std::memcpy(&current_value, &values[i], sizeof(current_value));
+
+    const uint32_t xor_value = current_value ^ last_value;
+
+    if (xor_value == 0) {
+      buffer.writeFixed<0b0, 1>();
+    } else {
+      int lzb = getLeadingZeroBits(xor_value);
+      const int tzb = getTrailingZeroBits(xor_value);
+
+      if (data_bits != 0 && prev_lzb <= lzb && prev_tzb <= tzb) {
+        buffer.writeFixed<0b01, 2>();
+      } else {
+        if (lzb > 15) lzb = 15;
+
+        data_bits = 8 * sizeof(uint32_t) - lzb - tzb;
+
+        buffer.writeFixed<0b11, 2>();
+        buffer.write<4>(lzb);
+        buffer.write<5>(data_bits != 32 ? data_bits : 0);
+
+        prev_lzb = lzb;
+        prev_tzb = tzb;
+      }
+
+      buffer.write(xor_value >> prev_tzb, data_bits);
+    }
+
+    last_value = current_value;
+  }
+
+  out.write(buffer);
+}
+
+void FloatEncoder::decode32(Slice& values, std::vector<float>& out, uint32_t size) {
+  const size_t begin = out.size();
+
+  out.resize(begin + size);
+  out.resize(begin + decode32(values, out.data() + begin, size));
+}
+
+uint32_t FloatEncoder::decode32(Slice& values, float* out, uint32_t size) {
+  if (size == 0) return 0;
+
+  BitReader reader(values.data + values.offset, values.bytesLeft());
+  values.offset = values.length_;
+
+  uint32_t value = reader.read(32);
+  int tzb = 0;
+  int dataBits = 32;
+
+  const auto next = [&](auto checked) {
+    const uint64_t control = reader.peek<checked>();
+
+    if (control & 1) {
+      if (control & 2) {
+        const int lzb = (control >> 2) & 15;
+        const int headerBits = (control >> 6) & 31;
+
+        dataBits = headerBits == 0 ? 32 : headerBits;
+        tzb = (32 - lzb - dataBits) & 31;
+        reader.skip(11);
+      } else {
+        reader.skip(2);
+      }
+
+      value ^= static_cast<uint32_t>(reader.read<checked>(dataBits)) << tzb;
+    } else {
+      reader.skip(1);
+    }
+
+    float decoded;
+    std::memcpy(&decoded, &value, sizeof(decoded));
+    return decoded;
+  };
+
+  std::memcpy(out, &value, sizeof(value));
+
+  // Values other than the first take at most 2 + 4 + 5 + 32 bits
+  constexpr size_t maxValueBits = 43;
+  uint32_t i = 1;
+
+  while (i < size) {
+    const size_t unchecked = std::min<size_t>(size - i, reader.uncheckedBits() / maxValueBits);
+    if (unchecked == 0) break;
+
+    for (const uint32_t end = i + unchecked; i < end; i++) out[i] = next(std::false_type{});
+  }
+
+  for (; i < size; i++) out[i] = next(std::true_type{});
+
+  if (reader.overran()) throw std::runtime_error("Invalid data format");
+  return size;
+}
+
+size_t FloatEncoder::maxEncodedSize32(size_t size) {
+  const size_t bits = 32 + (size > 0 ? size - 1 : 0) * (2 + 4 + 5 + 32);
+  return (bits / 64 + 1) * sizeof(uint64_t);
 }
 
 // Helper function to convert uint64_t back to double
@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <vector>
 
+#include "aligned_buffer.hpp"
 #include "compressed_buffer.hpp"
 #include "slice_buffer.hpp"
 
@@ -13,7 +14,69 @@ class FloatEncoder {
   FloatEncoder(){};
 
   static CompressedBuffer encode(const std::vector<double>& values);
-  static void decode(CompressedSlice& values, std::vector<double>& out, uint32_t size);
+  static void decode(Slice& values, std::vector<double>& out, uint32_t size);
+
+  // Decodes up to size values into out, returns how many were written
+  static uint32_t decode(Slice& values, double* out, uint32_t size);
+
+  // Gorilla words appended to an AlignedBuffer, for the codec selector
+  static void encode(const std::vector<double>& values, AlignedBuffer& out);
+
+  // Plain little endian doubles, for series that XOR encoding would grow
+  static void encodeRaw(const std::vector<double>& values, AlignedBuffer& out);
+  static void decodeRaw(Slice& values, std::vector<double>& out, uint32_t size);
+  static uint32_t decodeRaw(Slice& values, double* out, uint32_t size);
+
+  // Gorilla words compressed again with snappy, for repeating patterns
+  static void encodeSnappy(const std::vector<double>& values, AlignedBuffer& out);
+  static void decodeSnappy(Slice& values, std::vector<double>& out, uint32_t size);
+  static uint32_t decodeSnappy(Slice& values, double* out, uint32_t size);
+
+  // Gorilla with the control codes and window fields split from the data bits
+  // and Huffman coded, smaller where the same few windows keep recurring
+  static void encodeEntropy(const std::vector<double>& values, AlignedBuffer& out);
+  static void decodeEntropy(Slice& values, std::vector<double>& out, uint32_t size);
+  static uint32_t decodeEntropy(Slice& values, double* out, uint32_t size);
+
+  // FPC: each value is XORed with the better of a finite context (FCM) and a
+  // differential finite context (DFCM) prediction, both hash table lookups,
+  // which catches patterns that repeat further back than the previous value
+  static void encodeFpc(const std::vector<double>& values, AlignedBuffer& out);
+  static void decodeFpc(Slice& values, std::vector<double>& out, uint32_t size);
+  static uint32_t decodeFpc(Slice& values, double* out, uint32_t size);
+
+  // The bytes of every value split into eight planes, which snappy compresses
+  // far better than whole doubles when the high bytes repeat
+  static void encodeShuffle(const std::vector<double>& values, AlignedBuffer& out);
+  static void decodeShuffle(Slice& values, std::vector<double>& out, uint32_t size);
+  static uint32_t decodeShuffle(Slice& values, double* out, uint32_t size);
+
+  // Gorilla with runs of repeats coded as a varint count, so a flatline takes a
+  // few bits in all and is decoded with a single fill
+  static void encodeRuns(const std::vector<double>& values, AlignedBuffer& out);
+  static void decodeRuns(Slice& values, std::vector<double>& out, uint32_t size);
+  static uint32_t decodeRuns(Slice& values, double* out, uint32_t size);
+
+  // Whole numbers within the safe integer range, which take fewer bits as
+  // integer deltas than as XORed doubles. -0 is not one as it would decode as 0
+  static bool isIntegral(const std::vector<double>& values);
+
+  // Integral values in the integer codec's PFOR hybrid layout, converted back to doubles on decode
+  static void encodeIntegers(const std::vector<double>& values, AlignedBuffer& out);
+  static void decodeIntegers(Slice& values, std::vector<double>& out, uint32_t size);
+  static uint32_t decodeIntegers(Slice& values, double* out, uint32_t size);
+
+  // Upper bound of the encoded size of size values with any of the layouts
+  // above, integral values are only stored as integers when that is smaller
+  static size_t maxEncodedSize(size_t size);
+
+  // Gorilla on the 32 bit words of single precision values, with 4 bit
+  // leading zero and 5 bit length fields
+  static void encode32(const std::vector<float>& values, AlignedBuffer& out);
+  static void decode32(Slice& values, std::vector<float>& out, uint32_t size);
+  static uint32_t decode32(Slice& values, float* out, uint32_t size);
+  static size_t maxEncodedSize32(size_t size);
+
   static uint64_t getUint64Representation(double value);
   static double getDoubleRepresentation(uint64_t intRepresentation);
 };
@@ -1,176 +1,261 @@
+#include "boolean_encoder.hpp"
+#include "buffer_header.hpp"
+#include "codec_selector.hpp"
 #include "float_encoder.hpp"
 #include "integer_encoder.hpp"
+#include "segment.hpp"
+#include "stats.hpp"
+#include "string_encoder.hpp"
+#include <algorithm>
 #include <cstring>
+#include <limits>
+#include <memory>
 #include <napi.h>
 #include <snappy.h>
+#include <stdexcept>
 #include <stdint.h>
 #include <variant>
 #include <vector>
 
 using namespace Napi;
 
-enum CompressionType : uint8_t {
-  INTEGER_ENCODER = 0,
-  FLOAT_ENCODER = 1,
-  BOOLEAN_ENCODER = 2,
-  STRING_ENCODER = 3,
-  SNAPPY = 10
+// Options of encode and encodeInto
+struct EncodeOptions {
+  // Values each candidate codec encodes when picking one, 0 to always use the default
+  uint32_t sampleSize = CodecSelector::defaultSampleSize;
+
+  // Also try the entropy coded float layout, for cold data where size matters more than encode time
+  bool highRatio = false;
+};
+
+using Values = std::variant<std::vector<int64_t>, std::vector<double>, std::vector<uint8_t>, std::vector<std::string>,
+                            std::vector<float>>;
+
+// The values of one series, empty columns use booleans like encoding empty arrays
+struct Column {
+  std::string name;
+  Values values = std::vector<uint8_t>{};
+
+  // Dictionary encoded strings are kept as codes until the JS array is built
+  std::vector<std::string> dictionary;
+  std::vector<uint64_t> dictionaryCodes;
+
+  // 0 for each null value, empty when there are none. Null values still take
+  // a default constructed slot in values or dictionaryCodes
+  std::vector<uint8_t> validity;
 };
 
 struct CompressionCarrier {
   napi_deferred deferred;
   napi_async_work work;
   std::vector<uint64_t> timestamps;
-  std::variant<std::vector<int64_t>, std::vector<double>, std::vector<bool>, std::vector<std::string>> values;
+  std::vector<Column> columns;
   std::vector<uint8_t> compressedData;
+
+  // Caller owned buffer encodeInto copies compressedData to, when set
+  uint8_t* target = nullptr;
+  size_t targetLength = 0;
+  napi_ref targetRef = nullptr;
+
+  // Columns share one timestamps section and are returned by name
+  bool multiColumn = false;
+
+  // Names of the columns to decode, every column when empty
+  std::vector<std::string> selectedColumns;
+
+  // Return typed arrays instead of JS arrays where the value type allows it
+  bool typedArrays = false;
+
+  EncodeOptions options;
+
+  // Encoded blocks to decode, either compressedData or pages of a mapped
+  // segment, which is kept alive until the decode completes
+  std::vector<std::pair<const uint8_t*, size_t>> blocks;
+  std::shared_ptr<MappedSegment> segment;
+
+  // Only keep the points within [from, to]
+  bool hasRange = false;
+  uint64_t from = 0;
+  uint64_t to = UINT64_MAX;
+
+  // Set when a block fails to decode, the promise is rejected with it
+  std::string error;
 };
 
-enum class VariantType { Int64, Double, Bool, String };
+enum class VariantType { Int64, Double, Bool, String, Float32 };
 
-VariantType getVariantType(
-    const std::variant<std::vector<int64_t>, std::vector<double>, std::vector<bool>, std::vector<std::string>>& var) {
+VariantType getVariantType(const Values& var) {
   if (std::holds_alternative<std::vector<int64_t>>(var)) return VariantType::Int64;
   if (std::holds_alternative<std::vector<double>>(var)) return VariantType::Double;
-  if (std::holds_alternative<std::vector<bool>>(var)) return VariantType::Bool;
+  if (std::holds_alternative<std::vector<uint8_t>>(var)) return VariantType::Bool;
   if (std::holds_alternative<std::vector<std::string>>(var)) return VariantType::String;
+  if (std::holds_alternative<std::vector<float>>(var)) return VariantType::Float32;
 
   throw std::runtime_error("Unsupported type");
 }
 
-void CompressFloats(CompressionCarrier* carrier) {
-  std::vector<double>& doubleVector = std::get<std::vector<double>>(carrier->values);
-
-  // Use our custom FloatEncoder to compress the data
-  CompressedBuffer encodeBuffer = FloatEncoder::encode(doubleVector);
+// Size of the decoded values held by a column
+size_t RawByteSize(const Column& column) {
+  switch (getVariantType(column.values)) {
+    case VariantType::Int64:
+      return std::get<std::vector<int64_t>>(column.values).size() * sizeof(int64_t);
+    case VariantType::Double:
+      return std::get<std::vector<double>>(column.values).size() * sizeof(double);
+    case VariantType::Bool:
+      return std::get<std::vector<uint8_t>>(column.values).size();
+    case VariantType::Float32:
+      return std::get<std::vector<float>>(column.values).size() * sizeof(float);
+    case VariantType::String: {
+      size_t size = column.dictionaryCodes.size() * sizeof(uint64_t);
+      for (const auto& str : std::get<std::vector<std::string>>(column.values)) size += str.size();
+      return size;
+    }
+  }
 
-  // Copy the encoded data into the compressedData vector
-  const size_t prefixSize = sizeof(CompressionType);
-  const size_t offset = carrier->compressedData.size();
+  return 0;
+}
 
-  carrier->compressedData.resize(offset + prefixSize + encodeBuffer.data.size() * sizeof(uint64_t));
-  carrier->compressedData[offset] = FLOAT_ENCODER;
+// Size of the decoded timestamps and values held by the carrier
+size_t RawByteSize(CompressionCarrier* carrier) {
+  size_t size = carrier->timestamps.size() * sizeof(uint64_t);
 
-  const uint8_t* encoded_uint8 = reinterpret_cast<const uint8_t*>(encodeBuffer.data.data());
+  for (const auto& column : carrier->columns) size += RawByteSize(column);
 
-  std::copy(encoded_uint8, encoded_uint8 + encodeBuffer.data.size() * sizeof(uint64_t),
-            carrier->compressedData.begin() + prefixSize + offset);
+  return size;
 }
 
-void CompressStrings(CompressionCarrier* carrier) {
-  std::vector<std::string>& strings = std::get<std::vector<std::string>>(carrier->values);
-
-  std::string concatenatedData;
+// Appends a [uint8 type][values] section
+void WriteSection(std::vector<uint8_t>& out, uint8_t type, const AlignedBuffer& encodeBuffer) {
+  out.push_back(type);
+  out.insert(out.end(), encodeBuffer.data.begin(), encodeBuffer.data.end());
+}
 
-  // Concatenate the strings into a binary buffer with a 32-bit unsigned int
-  // prefix for each string's length
-  for (const auto& str : strings) {
-    uint32_t length = static_cast<uint32_t>(str.size());
-    concatenatedData.append(reinterpret_cast<char*>(&length), sizeof(length));
-    concatenatedData.append(str);
+// Float codecs the selector picks from, the first is used when sampling is turned off
+const Codec<double> floatCodecs[] = {{FLOAT_ENCODER, FloatEncoder::encode},
+                                     {FLOAT_RAW_ENCODER, FloatEncoder::encodeRaw},
+                                     {FLOAT_SNAPPY_ENCODER, FloatEncoder::encodeSnappy},
+                                     {FLOAT_FPC_ENCODER, FloatEncoder::encodeFpc},
+                                     {FLOAT_SHUFFLE_ENCODER, FloatEncoder::encodeShuffle},
+                                     {FLOAT_RUNS_ENCODER, FloatEncoder::encodeRuns}};
+
+// Float codecs of the high ratio mode, the entropy coded layout is used when sampling is turned off
+const Codec<double> highRatioFloatCodecs[] = {{FLOAT_ENTROPY_ENCODER, FloatEncoder::encodeEntropy},
+                                              {FLOAT_ENCODER, FloatEncoder::encode},
+                                              {FLOAT_RAW_ENCODER, FloatEncoder::encodeRaw},
+                                              {FLOAT_SNAPPY_ENCODER, FloatEncoder::encodeSnappy},
+                                              {FLOAT_FPC_ENCODER, FloatEncoder::encodeFpc},
+                                              {FLOAT_SHUFFLE_ENCODER, FloatEncoder::encodeShuffle},
+                                              {FLOAT_RUNS_ENCODER, FloatEncoder::encodeRuns}};
+
+void CompressFloats(const Column& column, const EncodeOptions& options, std::vector<uint8_t>& out) {
+  const std::vector<double>& doubleVector = std::get<std::vector<double>>(column.values);
+
+  AlignedBuffer encodeBuffer;
+
+  // Use whichever float codec encodes a sample of the series best
+  const CompressionType encodeType =
+      options.highRatio ? CodecSelector::encode(doubleVector, options.sampleSize, highRatioFloatCodecs, encodeBuffer)
+                        : CodecSelector::encode(doubleVector, options.sampleSize, floatCodecs, encodeBuffer);
+
+  // Whole numbers such as counts and byte sizes are usually far smaller as
+  // integer deltas, they take the integer codec when it beats the sampled pick
+  if (options.sampleSize > 0 && FloatEncoder::isIntegral(doubleVector)) {
+    AlignedBuffer integerBuffer;
+    FloatEncoder::encodeIntegers(doubleVector, integerBuffer);
+
+    if (integerBuffer.size() < encodeBuffer.size()) {
+      WriteSection(out, FLOAT_INTEGER_ENCODER, integerBuffer);
+      return;
+    }
   }
 
-  // Compress the data with Snappy
-  std::string compressedData;
-  snappy::Compress(concatenatedData.data(), concatenatedData.size(), &compressedData);
+  WriteSection(out, encodeType, encodeBuffer);
+}
+
+// Single precision values keep their 32 bit words through the codec
+void CompressFloats32(const Column& column, std::vector<uint8_t>& out) {
+  AlignedBuffer encodeBuffer;
+  FloatEncoder::encode32(std::get<std::vector<float>>(column.values), encodeBuffer);
 
-  // Copy the compressed data into the compressedData vector
+  WriteSection(out, FLOAT32_ENCODER, encodeBuffer);
+}
 
-  const size_t prefixSize = sizeof(CompressionType);
-  const size_t offset = carrier->compressedData.size();
+void CompressStrings(const Column& column, std::vector<uint8_t>& out) {
+  const std::vector<std::string>& strings = std::get<std::vector<std::string>>(column.values);
 
-  carrier->compressedData.resize(offset + prefixSize + compressedData.size());
+  // Low cardinality series store each unique string once, while series
+  // where neighbours share long prefixes only store what changed
+  AlignedBuffer encodeBuffer;
+  CompressionType encodeType = STRING_ENCODER;
 
-  carrier->compressedData[offset] = STRING_ENCODER;
+  if (StringEncoder::encodeDictionary(strings, encodeBuffer)) {
+    encodeType = STRING_DICTIONARY_ENCODER;
+  } else if (StringEncoder::encodeFrontCoded(strings, encodeBuffer)) {
+    encodeType = STRING_FRONT_CODED_ENCODER;
+  } else {
+    StringEncoder::encodeSnappy(strings, encodeBuffer);
+  }
 
-  std::copy(compressedData.begin(), compressedData.end(), carrier->compressedData.begin() + prefixSize + offset);
+  WriteSection(out, encodeType, encodeBuffer);
 }
 
-void DecompressString(CompressionCarrier* carrier, int offset) {
-  char* buffer_data = (char*)carrier->compressedData.data() + offset;
-  size_t buffer_length = carrier->compressedData.size() - offset;
-
-  // Decompress the data with Snappy
-  std::string decompressedData;
-  if (!snappy::Uncompress(buffer_data, buffer_length, &decompressedData)) {
-    throw std::runtime_error("Invalid data format");
-    return;
-  }
+void DecompressString(Column& column, const uint8_t* data, size_t length, uint32_t itemCount) {
+  Slice buffer(data, length);
 
-  carrier->values = std::vector<std::string>{};
+  column.values = std::vector<std::string>{};
+  std::vector<std::string>& strings = std::get<std::vector<std::string>>(column.values);
 
-  std::vector<std::string>& strings = std::get<std::vector<std::string>>(carrier->values);
-  size_t index = 0;
-  while (index < decompressedData.size()) {
-    uint32_t length = *(reinterpret_cast<uint32_t*>(decompressedData.data() + index));
-    index += sizeof(uint32_t);
-    if (index + length > decompressedData.size()) {
-      return;
-    }
-    strings.push_back(decompressedData.substr(index, length));
-    index += length;
-  }
+  StringEncoder::decodeSnappy(buffer, strings, itemCount);
 }
 
-void CompressBoolean(CompressionCarrier* carrier) {
-  std::vector<bool>& boolVector = std::get<std::vector<bool>>(carrier->values);
-  uint32_t numBooleans = boolVector.size();
+void DecompressStringDictionary(Column& column, const uint8_t* data, size_t length, uint32_t itemCount) {
+  Slice buffer(data, length);
+
+  column.values = std::vector<std::string>{};
 
-  std::vector<uint8_t> data;
-  data.resize(sizeof(uint32_t) + (numBooleans + 7) / 8,
-              0);  // Account for size prefix and padding bits
+  StringEncoder::decodeDictionary(buffer, column.dictionary, column.dictionaryCodes, itemCount);
+}
 
-  // Store the size prefix in the data
-  uint32_t* sizePrefixPtr = reinterpret_cast<uint32_t*>(data.data());
-  *sizePrefixPtr = numBooleans;
+void DecompressStringFrontCoded(Column& column, const uint8_t* data, size_t length, uint32_t itemCount) {
+  Slice buffer(data, length);
 
-  uint8_t* bitsDataStart = data.data() + sizeof(uint32_t);
-  uint8_t currentByte = 0;
-  unsigned int bitsSet = 0;
+  column.values = std::vector<std::string>{};
+  std::vector<std::string>& strings = std::get<std::vector<std::string>>(column.values);
 
-  // Read the array elements from JavaScript and store them as bits
-  for (unsigned int i = 0; i < numBooleans; i++) {
-    // Get the current array element
-    bool value = boolVector[i];
-    // If the boolean value is true, set the bit in the current byte
-    if (value) {
-      currentByte |= 1 << (7 - (bitsSet % 8));
-    }
+  StringEncoder::decodeFrontCoded(buffer, strings, itemCount);
+}
 
-    if (++bitsSet % 8 == 0) {
-      // If we have set 8 bits, store the current byte in the data and reset
-      *(bitsDataStart++) = currentByte;
-      currentByte = 0;
-    }
-  }
+void CompressBoolean(const Column& column, std::vector<uint8_t>& out) {
+  const std::vector<uint8_t>& boolVector = std::get<std::vector<uint8_t>>(column.values);
 
-  // If there are remaining bits that have not been stored in the data, do so
-  // now
-  if (bitsSet % 8 != 0) {
-    *bitsDataStart = currentByte;
-  }
+  AlignedBuffer encodeBuffer = BooleanEncoder::encode(boolVector.data(), boolVector.size());
 
-  // Copy the encoded data into the compressedData vector
-  const size_t prefixSize = sizeof(CompressionType);
-  const size_t offset = carrier->compressedData.size();
+  WriteSection(out, BOOLEAN_HYBRID_ENCODER, encodeBuffer);
+}
+
+void DecompressBooleanHybrid(Column& column, const uint8_t* data, size_t length, uint32_t itemCount) {
+  Slice buffer(data, length);
 
-  carrier->compressedData.resize(offset + prefixSize + data.size());
-  carrier->compressedData[offset] = BOOLEAN_ENCODER;
+  column.values = std::vector<uint8_t>(itemCount);
+  std::vector<uint8_t>& boolVector = std::get<std::vector<uint8_t>>(column.values);
 
-  std::copy(data.begin(), data.end(), carrier->compressedData.begin() + prefixSize + offset);
+  BooleanEncoder::decode(buffer, boolVector.data(), itemCount);
 }
 
-void DecompressBoolean(CompressionCarrier* carrier, int offset) {
-  uint8_t* buffer_data = (uint8_t*)carrier->compressedData.data() + offset;
-  size_t buffer_length = carrier->compressedData.size() - offset;
+// Legacy BOOLEAN_ENCODER buffers, one bit per value, most significant bit first
+void DecompressBoolean(Column& column, const uint8_t* data, size_t length) {
+  const uint8_t* buffer_data = data;
+  size_t buffer_length = length;
 
   // Read the size prefix from the data
-  uint32_t numBooleans = *(reinterpret_cast<uint32_t*>(buffer_data));
+  uint32_t numBooleans;
+  std::memcpy(&numBooleans, buffer_data, sizeof(uint32_t));
   buffer_data += sizeof(uint32_t);
   buffer_length -= sizeof(uint32_t);
 
   // Create a vector to store the decompressed data
-  carrier->values = std::vector<bool>{};
-  std::vector<bool>& boolVector = std::get<std::vector<bool>>(carrier->values);
+  column.values = std::vector<uint8_t>{};
+  std::vector<uint8_t>& boolVector = std::get<std::vector<uint8_t>>(column.values);
   boolVector.resize(numBooleans);
 
   uint8_t currentByte = 0;
@@ -185,425 +270,1866 @@ void DecompressBoolean(CompressionCarrier* carrier, int offset) {
     }
 
     // Get the bit at the current position
-    boolVector[i] = (currentByte & (1 << (7 - (bitsRead % 8)))) != 0;
+    boolVector[i] = (currentByte >> (7 - (bitsRead % 8))) & 1;
     bitsRead++;
   }
 }
 
-void ExecuteCompression(napi_env env, void* data) {
-  CompressionCarrier* carrier = static_cast<CompressionCarrier*>(data);
-
-  const size_t prefixSize = sizeof(CompressionType) + sizeof(uint32_t) + sizeof(uint32_t);
-  carrier->compressedData.resize(prefixSize);
-
-  int offset = 0;
+void CompressValues(const Column& column, const EncodeOptions& options, std::vector<uint8_t>& out);
 
-  // Encode timestamps
+// Nullable layout:
+//   [uint32 validity byte length][BooleanEncoder validity][uint8 value type][non-null values]
+void CompressNullable(const Column& column, const EncodeOptions& options, std::vector<uint8_t>& out) {
+  AlignedBuffer validityBuffer = BooleanEncoder::encode(column.validity.data(), column.validity.size());
 
-  const uint8_t timestampTypePrefix = static_cast<uint8_t>(INTEGER_ENCODER);
-  carrier->compressedData[offset] = timestampTypePrefix;
-  offset += sizeof(uint8_t);
+  // Only the non-null values reach the value codec
+  Column present;
 
-  // Add the total number of items to the compressed data
+  std::visit(
+      [&](const auto& values) {
+        std::decay_t<decltype(values)> presentValues;
+        presentValues.reserve(values.size());
 
-  uint32_t* sizePtr = (uint32_t*)&carrier->compressedData[offset];
-  *sizePtr = carrier->timestamps.size();
-  offset += sizeof(uint32_t);
+        for (size_t i = 0; i < values.size(); i++) {
+          if (column.validity[i]) presentValues.push_back(values[i]);
+        }
 
-  AlignedBuffer timestampsBuffer = IntegerEncoder::encode(carrier->timestamps);
+        present.values = std::move(presentValues);
+      },
+      column.values);
 
-  // Add the total number of items to the compressed data
-  uint32_t* timestampeLengthPtr = (uint32_t*)&carrier->compressedData[offset];
-  *timestampeLengthPtr = timestampsBuffer.data.size();
-  offset += sizeof(uint32_t);
+  out.push_back(NULLABLE_ENCODER);
 
-  carrier->compressedData.resize(offset + timestampsBuffer.data.size());
+  const uint32_t validityLength = validityBuffer.size();
+  const size_t offset = out.size();
 
-  std::copy(timestampsBuffer.data.data(), timestampsBuffer.data.data() + timestampsBuffer.data.size(),
-            carrier->compressedData.begin() + offset);
+  out.resize(offset + sizeof(uint32_t));
+  std::memcpy(out.data() + offset, &validityLength, sizeof(uint32_t));
+  out.insert(out.end(), validityBuffer.data.begin(), validityBuffer.data.end());
 
-  offset += timestampsBuffer.data.size();
+  CompressValues(present, options, out);
+}
 
-  // Encode values
+// Appends a [uint8 type][values] section
+void CompressValues(const Column& column, const EncodeOptions& options, std::vector<uint8_t>& out) {
+  if (!column.validity.empty()) {
+    CompressNullable(column, options, out);
+    return;
+  }
 
-  switch (getVariantType(carrier->values)) {
+  switch (getVariantType(column.values)) {
     case VariantType::Int64:
       // Handle int64_t
       break;
     case VariantType::Double:
-      CompressFloats(carrier);
+      CompressFloats(column, options, out);
+      break;
+    case VariantType::Float32:
+      CompressFloats32(column, out);
       break;
     case VariantType::Bool:
-      CompressBoolean(carrier);
+      CompressBoolean(column, out);
       break;
     case VariantType::String:
-      CompressStrings(carrier);
+      CompressStrings(column, out);
       break;
     default:
       // Handle error
       break;
   }
+}
 
-  // Try compressing the buffer with Snappy
+// Appends the [uint8 type][values] section of a column
+void CompressColumn(const Column& column, size_t itemCount, const EncodeOptions& options, std::vector<uint8_t>& out) {
+  StageTimer valuesTimer(STAGE_VALUE_ENCODE, itemCount, [&] { return RawByteSize(column); });
+  const size_t valuesOffset = out.size();
 
-  std::string snappyOutput;
-  snappy::Compress(reinterpret_cast<const char*>(carrier->compressedData.data()), carrier->compressedData.size(),
-                   &snappyOutput);
+  CompressValues(column, options, out);
 
-  // If the Snappy compressed buffer is smaller, use it instead
+  if (out.size() > valuesOffset) {
+    valuesTimer.setType(out[valuesOffset]);
+    valuesTimer.setBytes(out.size() - valuesOffset);
+  }
+}
+
+// Upper bound of the [uint8 type][values] section CompressValues appends for values
+size_t MaxValuesSize(const Values& values) {
+  switch (getVariantType(values)) {
+    case VariantType::Double:
+      return sizeof(uint8_t) + FloatEncoder::maxEncodedSize(std::get<std::vector<double>>(values).size());
+    case VariantType::Float32:
+      return sizeof(uint8_t) + FloatEncoder::maxEncodedSize32(std::get<std::vector<float>>(values).size());
+    case VariantType::Bool:
+      return sizeof(uint8_t) + BooleanEncoder::maxEncodedSize(std::get<std::vector<uint8_t>>(values).size());
+    case VariantType::String:
+      return sizeof(uint8_t) + StringEncoder::maxEncodedSize(std::get<std::vector<std::string>>(values));
+    default:
+      return 0;
+  }
+}
 
-  if (false && snappyOutput.size() < carrier->compressedData.size()) {
-    const int outputSize = sizeof(CompressionType) + snappyOutput.size();
+// Upper bound of the values section of a column, the non-null values of a
+// nullable column never need more room than all of them
+size_t MaxColumnSize(const Column& column) {
+  const size_t valuesSize = MaxValuesSize(column.values);
 
-    carrier->compressedData.resize(outputSize);
-    carrier->compressedData[0] = static_cast<char>(SNAPPY);
+  if (column.validity.empty()) return valuesSize;
 
-    std::copy(snappyOutput.begin(), snappyOutput.end(), carrier->compressedData.begin() + sizeof(CompressionType));
-  }
+  return sizeof(uint8_t) + sizeof(uint32_t) + BooleanEncoder::maxEncodedSize(column.validity.size()) + valuesSize;
 }
 
-void ExecuteDecompression(napi_env env, void* data) {
-  CompressionCarrier* carrier = static_cast<CompressionCarrier*>(data);
+// Upper bound of the size of the buffer ExecuteCompression writes for the carrier
+size_t MaxEncodedSize(const CompressionCarrier* carrier) {
+  BufferHeader header;
+  header.hasTimeBounds = true;
 
-  if (carrier->compressedData[0] == SNAPPY) {
-    // Get the size of the data
-    const char* data = (const char*)carrier->compressedData.data() + 1;
+  size_t bound = header.prefixSize() + IntegerEncoder::maxEncodedSize(carrier->timestamps.size());
 
-    std::string decompressedData;
-    snappy::Uncompress(data, carrier->compressedData.size() - 1, &decompressedData);
+  if (!carrier->multiColumn) return bound + MaxColumnSize(carrier->columns[0]);
 
-    carrier->compressedData.resize(decompressedData.size());
-    std::copy(decompressedData.begin(), decompressedData.end(), carrier->compressedData.begin());
+  bound += sizeof(uint8_t) + sizeof(uint32_t);
+
+  for (const auto& column : carrier->columns) {
+    bound += 2 * sizeof(uint32_t) + column.name.size() + MaxColumnSize(column);
   }
 
-  int offset = 0;
+  return bound;
+}
 
-  offset += sizeof(uint8_t);
+void CompressCarrier(CompressionCarrier* carrier) {
+  BufferHeader header;
+  header.itemCount = carrier->timestamps.size();
 
-  const uint32_t* itemCount = reinterpret_cast<const uint32_t*>(&carrier->compressedData[offset]);
-  offset += sizeof(uint32_t);
+  // Store the time bounds so buffers can be pruned without decoding them
+  header.hasTimeBounds = true;
 
-  // Decode the timestamps
+  if (!carrier->timestamps.empty()) {
+    const auto bounds = std::minmax_element(carrier->timestamps.begin(), carrier->timestamps.end());
+    header.minTimestamp = *bounds.first;
+    header.maxTimestamp = *bounds.second;
+  }
 
-  const uint32_t* sizePtr = reinterpret_cast<const uint32_t*>(&carrier->compressedData[offset]);
-  offset += sizeof(uint32_t);
+  // Encode timestamps, scaled down when they share a common stride
 
-  Slice timestampsSlice(carrier->compressedData.data() + offset, *sizePtr);
-  IntegerEncoder::decode(timestampsSlice, carrier->timestamps, *itemCount);
+  StageTimer timestampsTimer(STAGE_TIMESTAMP_ENCODE, header.itemCount, header.itemCount * sizeof(int64_t));
 
-  offset += *sizePtr;
+  const uint64_t divisor = IntegerEncoder::commonDivisor(carrier->timestamps);
 
-  // Get the compression type
-  const uint8_t compressionType = carrier->compressedData[offset];
-  offset += sizeof(uint8_t);
+  // Jittery timestamps pack better in PFOR blocks, which fall back to Simple8B block by block, while
+  // short or regular series keep the plain Simple8B stream when it saves the block headers
+  AlignedBuffer encoded, timestampsBuffer;
 
-  switch (compressionType) {
-    case FLOAT_ENCODER: {
-      CompressedSlice buffer(carrier->compressedData.data() + offset, carrier->compressedData.size() - offset);
+  if (IntegerEncoder::encodeSmallest(carrier->timestamps, divisor, encoded)) {
+    header.timestampType = INTEGER_PFOR_ENCODER;
+    timestampsBuffer.data.swap(encoded.data);
+  } else if (divisor > 1) {
+    header.timestampType = INTEGER_SCALED_ENCODER;
+    timestampsBuffer.write(divisor);
+    timestampsBuffer.write(encoded);
+  } else {
+    header.timestampType = INTEGER_ENCODER;
+    timestampsBuffer.data.swap(encoded.data);
+  }
 
-      carrier->values = std::vector<double>{};
-      std::vector<double>& doubleVector = std::get<std::vector<double>>(carrier->values);
+  header.timestampsLength = timestampsBuffer.size();
+  header.write(carrier->compressedData);
 
-      doubleVector.reserve(*itemCount);
+  const size_t offset = header.prefixSize();
 
-      // Decode the data
-      FloatEncoder::decode(buffer, doubleVector, *itemCount);
+  carrier->compressedData.resize(offset + timestampsBuffer.data.size());
 
-      break;
-    }
-    case STRING_ENCODER: {
-      DecompressString(carrier, offset);
-      break;
-    }
-    case BOOLEAN_ENCODER: {
-      DecompressBoolean(carrier, offset);
-      break;
-    }
-    default: {
-      break;
-    }
-  }
-}
+  std::copy(timestampsBuffer.data.data(), timestampsBuffer.data.data() + timestampsBuffer.data.size(),
+            carrier->compressedData.begin() + offset);
 
-void CompressionComplete(napi_env env, napi_status status, void* data) {
-  CompressionCarrier* carrier = static_cast<CompressionCarrier*>(data);
+  timestampsTimer.setBytes(timestampsBuffer.size());
+  timestampsTimer.stop();
 
-  napi_value result;
+  // Encode values
 
-  napi_create_buffer_copy(env, carrier->compressedData.size(), carrier->compressedData.data(), nullptr, &result);
+  if (!carrier->multiColumn) {
+    CompressColumn(carrier->columns[0], header.itemCount, carrier->options, carrier->compressedData);
+    return;
+  }
 
-  napi_resolve_deferred(env, carrier->deferred, result);
-  napi_delete_async_work(env, carrier->work);
-  delete carrier;
+  // Every column gets its own section after the one timestamps section
+  std::vector<std::string> names;
+  std::vector<std::vector<uint8_t>> sections(carrier->columns.size());
+
+  for (size_t i = 0; i < carrier->columns.size(); i++) {
+    names.push_back(carrier->columns[i].name);
+    CompressColumn(carrier->columns[i], header.itemCount, carrier->options, sections[i]);
+  }
+
+  carrier->compressedData.push_back(MULTI_COLUMN_ENCODER);
+  ColumnDirectory::write(names, sections, carrier->compressedData);
 }
 
-void DecompressionComplete(napi_env env, napi_status status, void* data) {
+void ExecuteCompression(napi_env env, void* data) {
   CompressionCarrier* carrier = static_cast<CompressionCarrier*>(data);
 
-  napi_value result, timestampsArray, valuesArray;
+  CompressCarrier(carrier);
 
-  // Create the result object
-  napi_create_object(env, &result);
+  // encodeInto copies to the caller's buffer here, off the main thread
+  if (carrier->target && carrier->compressedData.size() <= carrier->targetLength) {
+    StageTimer outputTimer(STAGE_OUTPUT, carrier->timestamps.size(), carrier->compressedData.size());
 
-  // Assuming timestamps are stored in carrier->timestamps, create the
-  // timestamps array
-  napi_create_array_with_length(env, carrier->timestamps.size(), &timestampsArray);
-  for (uint32_t i = 0; i < carrier->timestamps.size(); i++) {
-    napi_value num;
-    napi_create_double(env, carrier->timestamps[i], &num);
-    napi_set_element(env, timestampsArray, i, num);
+    std::memcpy(carrier->target, carrier->compressedData.data(), carrier->compressedData.size());
   }
+}
 
-  // Set the timestamps property on the result object
-  napi_set_named_property(env, result, "timestamps", timestampsArray);
+// Checks a values section against the item count before it is decoded, from its
+// lengths, counts and selectors alone, and throws if it is malformed. Float
+// layouts with their own headers check those as they are read, Gorilla streams
+// are checked once decoded for reads past their end, and snappy compressed
+// strings can only be counted once decompressed, so these are checked by their
+// decoders
+void ValidateValues(uint8_t compressionType, const uint8_t* values, size_t valuesLength, uint32_t itemCount) {
+  bool valid = true;
 
-  // Create the values array based on the variant type
-  switch (getVariantType(carrier->values)) {
-    case VariantType::Int64:
-      // Handle int64_t
+  switch (compressionType) {
+    case FLOAT_RAW_ENCODER: {
+      valid = valuesLength / sizeof(double) >= itemCount;
       break;
-    case VariantType::Double: {
-      std::vector<double>& doubleVector = std::get<std::vector<double>>(carrier->values);
-      napi_create_array_with_length(env, doubleVector.size(), &valuesArray);
-
-      for (uint32_t i = 0; i < doubleVector.size(); i++) {
-        napi_value num;
-        napi_create_double(env, doubleVector[i], &num);
-        napi_set_element(env, valuesArray, i, num);
-      }
-
+    }
+    case FLOAT_INTEGER_ENCODER: {
+      valid = IntegerEncoder::validateHybrid(values, valuesLength, itemCount);
       break;
     }
-    case VariantType::Bool: {
-      std::vector<bool>& boolVector = std::get<std::vector<bool>>(carrier->values);
-
-      napi_create_array_with_length(env, boolVector.size(), &valuesArray);
+    case FLOAT_ENCODER:
+    case FLOAT_SNAPPY_ENCODER:
+    case FLOAT_ENTROPY_ENCODER:
+    case FLOAT_FPC_ENCODER:
+    case FLOAT_SHUFFLE_ENCODER:
+    case FLOAT_RUNS_ENCODER:
+    case FLOAT32_ENCODER:
+    case STRING_ENCODER: {
+      break;
+    }
+    case STRING_DICTIONARY_ENCODER: {
+      valid = StringEncoder::validateDictionary(values, valuesLength, itemCount);
+      break;
+    }
+    case STRING_FRONT_CODED_ENCODER: {
+      valid = StringEncoder::validateFrontCoded(values, valuesLength, itemCount);
+      break;
+    }
+    case BOOLEAN_ENCODER: {
+      uint32_t numBooleans = 0;
+      if (valuesLength >= sizeof(uint32_t)) std::memcpy(&numBooleans, values, sizeof(uint32_t));
 
-      for (uint32_t i = 0; i < boolVector.size(); i++) {
-        napi_value boolean;
-        napi_get_boolean(env, boolVector[i], &boolean);
-        napi_set_element(env, valuesArray, i, boolean);
-      }
+      valid = valuesLength >= sizeof(uint32_t) && numBooleans == itemCount &&
+              (numBooleans + 7) / 8 <= valuesLength - sizeof(uint32_t);
       break;
     }
-    case VariantType::String: {
-      std::vector<std::string>& stringVector = std::get<std::vector<std::string>>(carrier->values);
-      napi_create_array_with_length(env, stringVector.size(), &valuesArray);
+    case BOOLEAN_HYBRID_ENCODER: {
+      valid = BooleanEncoder::validate(values, valuesLength, itemCount);
+      break;
+    }
+    case NULLABLE_ENCODER: {
+      // The validity is checked here, the present values once they are counted
+      uint32_t validityLength = 0;
+      if (valuesLength >= sizeof(uint32_t)) std::memcpy(&validityLength, values, sizeof(uint32_t));
 
-      for (uint32_t i = 0; i < stringVector.size(); i++) {
-        napi_value str;
-        napi_create_string_utf8(env, stringVector[i].c_str(), NAPI_AUTO_LENGTH, &str);
+      const size_t rest = valuesLength >= sizeof(uint32_t) ? valuesLength - sizeof(uint32_t) : 0;
 
-        napi_set_element(env, valuesArray, i, str);
-      }
+      valid = valuesLength >= sizeof(uint32_t) && validityLength < rest &&
+              BooleanEncoder::validate(values + sizeof(uint32_t), validityLength, itemCount);
 
+      if (valid) {
+        const uint8_t valueType = values[sizeof(uint32_t) + validityLength];
+        valid = valueType != NULLABLE_ENCODER && valueType != MULTI_COLUMN_ENCODER;
+      }
       break;
     }
-    default:
-      // Handle error
+    default: {
+      valid = false;
       break;
+    }
   }
 
-  // Set the values property on the result object
-  napi_set_named_property(env, result, "values", valuesArray);
+  if (!valid) throw std::runtime_error("Invalid data format");
+}
 
-  napi_resolve_deferred(env, carrier->deferred, result);
-  napi_delete_async_work(env, carrier->work);
+// Checks the timestamps and every values section of a buffer, so a block that
+// passed decodes without running out of data
+void ValidateBlock(const BufferHeader& header, const uint8_t* data) {
+  const uint8_t* timestamps = data + header.timestampsOffset;
+  size_t timestampsLength = header.timestampsLength;
+  bool valid = false;
 
-  delete carrier;
-}
+  switch (header.timestampType) {
+    case INTEGER_ENCODER: {
+      valid = IntegerEncoder::validate(timestamps, timestampsLength, header.itemCount);
+      break;
+    }
+    case INTEGER_SCALED_ENCODER: {
+      valid = timestampsLength >= sizeof(uint64_t) &&
+              IntegerEncoder::validate(timestamps + sizeof(uint64_t), timestampsLength - sizeof(uint64_t),
+                                       header.itemCount);
+      break;
+    }
+    case INTEGER_PFOR_ENCODER: {
+      valid = IntegerEncoder::validateHybrid(timestamps, timestampsLength, header.itemCount);
+      break;
+    }
+  }
 
-napi_value Encode(napi_env env, napi_callback_info info) {
-  size_t argc = 1;
-  napi_value args[1];
-  napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (!valid) throw std::runtime_error("Invalid data format");
 
-  // Check if the first argument is an object
-  // Check the type of the argument
-  napi_valuetype argType;
-  napi_typeof(env, args[0], &argType);
+  const uint8_t* values = data + header.valuesOffset;
 
-  if (argType != napi_object) {
-    napi_throw_type_error(env, nullptr, "Argument must be an object");
-    return nullptr;
+  if (header.valueType != MULTI_COLUMN_ENCODER) {
+    ValidateValues(header.valueType, values, header.valuesLength, header.itemCount);
+    return;
   }
 
-  napi_value timestampsValue, valuesValue;
-  napi_get_named_property(env, args[0], "timestamps", &timestampsValue);
-  napi_get_named_property(env, args[0], "values", &valuesValue);
+  ColumnDirectory directory;
+  if (!directory.read(values, header.valuesLength)) throw std::runtime_error("Invalid data format");
 
-  // Check if the timestamps and values properties are arrays
-  bool isTimestampsArray, isValuesArray;
-  napi_is_array(env, timestampsValue, &isTimestampsArray);
-  napi_is_array(env, valuesValue, &isValuesArray);
-  if (!isTimestampsArray || !isValuesArray) {
-    napi_throw_type_error(env, nullptr, "Both timestamps and values must be arrays");
-    return nullptr;
+  for (const auto& entry : directory.columns) {
+    ValidateValues(entry.valueType, values + entry.valuesOffset, entry.valuesLength, header.itemCount);
   }
+}
 
-  CompressionCarrier* carrier = new CompressionCarrier;
-
-  // Read the array elements from JavaScript and store them in a vector
+// Decodes the values section of a column
+void DecompressValues(Column& column, uint8_t compressionType, const uint8_t* values, size_t valuesLength,
+                      uint32_t itemCount);
 
-  uint32_t numTimestampValues;
-  napi_get_array_length(env, timestampsValue, &numTimestampValues);
+// Decodes the non-null values, then spreads them out to their positions
+void DecompressNullable(Column& column, const uint8_t* data, size_t length, uint32_t itemCount) {
+  Slice buffer(data, length);
 
-  uint32_t numValues;
-  napi_get_array_length(env, valuesValue, &numValues);
+  const uint32_t validityLength = buffer.read<uint32_t>();
+  Slice validitySlice = buffer.getSlice(validityLength);
 
-  if (numTimestampValues != numValues) {
-    napi_throw_type_error(env, nullptr, "Both timestamps and values must be arrays of the same length");
-    return nullptr;
-  }
+  column.validity.resize(itemCount);
+  BooleanEncoder::decode(validitySlice, column.validity.data(), itemCount);
 
-  carrier->timestamps.reserve(numTimestampValues);
+  const uint32_t presentCount = std::count(column.validity.begin(), column.validity.end(), 1);
+  const uint8_t valueType = buffer.read<uint8_t>();
 
-  for (uint32_t i = 0; i < numTimestampValues; i++) {
-    napi_value element;
-    napi_get_element(env, timestampsValue, i, &element);
+  ValidateValues(valueType, data + buffer.offset, buffer.bytesLeft(), presentCount);
+  DecompressValues(column, valueType, data + buffer.offset, buffer.bytesLeft(), presentCount);
 
-    double num_double;
-    napi_get_value_double(env, element, &num_double);
-    uint64_t num = static_cast<uint64_t>(num_double);
-    carrier->timestamps.push_back(num);
-  }
+  const auto spread = [&](auto& items) {
+    std::decay_t<decltype(items)> spreadItems(itemCount);
 
-  // Read the array elements from JavaScript and store them in a vector
+    for (size_t i = 0, j = 0; i < itemCount && j < items.size(); i++) {
+      if (column.validity[i]) spreadItems[i] = std::move(items[j++]);
+    }
 
-  napi_valuetype valuetype;
-  napi_value firstElement;
+    items = std::move(spreadItems);
+  };
 
-  if (numValues > 0) {
-    napi_get_element(env, valuesValue, 0, &firstElement);
-    napi_typeof(env, firstElement, &valuetype);
+  if (!column.dictionary.empty()) {
+    spread(column.dictionaryCodes);
   } else {
-    // Dummy type for encoding empty arrays
-    valuetype = napi_boolean;
+    std::visit(spread, column.values);
   }
+}
 
-  switch (valuetype) {
-    case napi_number: {
-      carrier->values = std::vector<double>{};
+// Decodes the values section of a column, without timing it
+void DecompressValues(Column& column, uint8_t compressionType, const uint8_t* values, size_t valuesLength,
+                      uint32_t itemCount) {
+  switch (compressionType) {
+    case FLOAT_ENCODER: {
+      Slice buffer(values, valuesLength);
 
-      std::vector<double>& numbers = std::get<std::vector<double>>(carrier->values);
-      numbers.reserve(numValues);
+      column.values = std::vector<double>{};
+      std::vector<double>& doubleVector = std::get<std::vector<double>>(column.values);
 
-      for (uint32_t i = 0; i < numValues; i++) {
-        napi_value element;
-        napi_get_element(env, valuesValue, i, &element);
+      doubleVector.reserve(itemCount);
 
-        napi_valuetype itemType;
-        napi_typeof(env, element, &itemType);
+      // Decode the data
+      FloatEncoder::decode(buffer, doubleVector, itemCount);
 
-        // Throw if not a number
-        if (itemType != napi_number) {
-          napi_throw_type_error(env, nullptr, "Values must all be numbers");
-          return nullptr;
-        }
+      break;
+    }
+    case FLOAT_RAW_ENCODER: {
+      Slice buffer(values, valuesLength);
 
-        double num;
-        napi_get_value_double(env, element, &num);
-        numbers.push_back(num);
-      }
+      column.values = std::vector<double>{};
+      FloatEncoder::decodeRaw(buffer, std::get<std::vector<double>>(column.values), itemCount);
       break;
     }
-    case napi_bigint: {
-      std::vector<int64_t>& numbers = std::get<std::vector<int64_t>>(carrier->values);
-      numbers.reserve(numValues);
+    case FLOAT_SNAPPY_ENCODER: {
+      Slice buffer(values, valuesLength);
 
-      for (uint32_t i = 0; i < numValues; i++) {
-        napi_value element;
-        napi_get_element(env, valuesValue, i, &element);
+      column.values = std::vector<double>{};
+      std::vector<double>& doubleVector = std::get<std::vector<double>>(column.values);
 
-        // Throw if not a napi_bigint
-        napi_valuetype itemType;
-        napi_typeof(env, element, &itemType);
+      doubleVector.reserve(itemCount);
+      FloatEncoder::decodeSnappy(buffer, doubleVector, itemCount);
+      break;
+    }
+    case FLOAT_ENTROPY_ENCODER: {
+      Slice buffer(values, valuesLength);
 
-        if (itemType != napi_bigint) {
-          napi_throw_type_error(env, nullptr, "Values must all be bigints");
-          return nullptr;
-        }
+      column.values = std::vector<double>{};
+      FloatEncoder::decodeEntropy(buffer, std::get<std::vector<double>>(column.values), itemCount);
+      break;
+    }
+    case FLOAT_FPC_ENCODER: {
+      Slice buffer(values, valuesLength);
 
-        int64_t num;
+      column.values = std::vector<double>{};
+      FloatEncoder::decodeFpc(buffer, std::get<std::vector<double>>(column.values), itemCount);
+      break;
+    }
+    case FLOAT_SHUFFLE_ENCODER: {
+      Slice buffer(values, valuesLength);
+
+      column.values = std::vector<double>{};
+      FloatEncoder::decodeShuffle(buffer, std::get<std::vector<double>>(column.values), itemCount);
+      break;
+    }
+    case FLOAT_RUNS_ENCODER: {
+      Slice buffer(values, valuesLength);
+
+      column.values = std::vector<double>{};
+      FloatEncoder::decodeRuns(buffer, std::get<std::vector<double>>(column.values), itemCount);
+      break;
+    }
+    case FLOAT_INTEGER_ENCODER: {
+      Slice buffer(values, valuesLength);
+
+      column.values = std::vector<double>{};
+      FloatEncoder::decodeIntegers(buffer, std::get<std::vector<double>>(column.values), itemCount);
+      break;
+    }
+    case FLOAT32_ENCODER: {
+      Slice buffer(values, valuesLength);
+
+      column.values = std::vector<float>{};
+      FloatEncoder::decode32(buffer, std::get<std::vector<float>>(column.values), itemCount);
+      break;
+    }
+    case STRING_ENCODER: {
+      DecompressString(column, values, valuesLength, itemCount);
+      break;
+    }
+    case STRING_DICTIONARY_ENCODER: {
+      DecompressStringDictionary(column, values, valuesLength, itemCount);
+      break;
+    }
+    case STRING_FRONT_CODED_ENCODER: {
+      DecompressStringFrontCoded(column, values, valuesLength, itemCount);
+      break;
+    }
+    case BOOLEAN_ENCODER: {
+      DecompressBoolean(column, values, valuesLength);
+      break;
+    }
+    case BOOLEAN_HYBRID_ENCODER: {
+      DecompressBooleanHybrid(column, values, valuesLength, itemCount);
+      break;
+    }
+    case NULLABLE_ENCODER: {
+      DecompressNullable(column, values, valuesLength, itemCount);
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+// Decodes the values section of a column
+void DecompressColumn(Column& column, uint8_t compressionType, const uint8_t* values, size_t valuesLength,
+                      uint32_t itemCount) {
+  StageTimer valuesTimer(STAGE_VALUE_DECODE, itemCount, valuesLength);
+  valuesTimer.setType(compressionType);
+
+  DecompressValues(column, compressionType, values, valuesLength, itemCount);
+}
+
+// Decodes the selected columns of a MULTI_COLUMN_ENCODER buffer, skipping the sections of the others
+void DecompressColumns(CompressionCarrier* carrier, const uint8_t* data, size_t length, uint32_t itemCount) {
+  carrier->multiColumn = true;
+
+  ColumnDirectory directory;
+  directory.read(data, length);
+
+  for (const auto& entry : directory.columns) {
+    const auto& selected = carrier->selectedColumns;
+    if (!selected.empty() && std::find(selected.begin(), selected.end(), entry.name) == selected.end()) continue;
+
+    Column& column = carrier->columns.emplace_back();
+    column.name = entry.name;
+
+    DecompressColumn(column, entry.valueType, data + entry.valuesOffset, entry.valuesLength, itemCount);
+  }
+}
+
+// Decodes the timestamps section into out, which must have room for header.itemCount
+// values, and returns how many were written
+size_t DecodeTimestamps(const BufferHeader& header, const uint8_t* data, uint64_t* out) {
+  StageTimer timestampsTimer(STAGE_TIMESTAMP_DECODE, header.itemCount, header.timestampsLength);
+
+  Slice timestampsSlice(data + header.timestampsOffset, header.timestampsLength);
+
+  if (header.timestampType == INTEGER_SCALED_ENCODER) {
+    const uint64_t divisor = timestampsSlice.read<uint64_t>();
+    Slice scaledSlice = timestampsSlice.getSlice(timestampsSlice.bytesLeft());
+
+    return IntegerEncoder::decode(scaledSlice, out, header.itemCount, divisor);
+  }
+
+  if (header.timestampType == INTEGER_PFOR_ENCODER) {
+    return IntegerEncoder::decodeHybrid(timestampsSlice, out, header.itemCount);
+  }
+
+  return IntegerEncoder::decode(timestampsSlice, out, header.itemCount);
+}
+
+// Decodes one encoded buffer into the carrier's timestamps and columns
+void DecodeBlock(CompressionCarrier* carrier, const uint8_t* data, size_t length) {
+  std::string decompressedData;
+
+  if (length > 0 && data[0] == SNAPPY) {
+    StageTimer snappyTimer(STAGE_SNAPPY, 0, length);
+
+    if (!snappy::Uncompress(reinterpret_cast<const char*>(data) + 1, length - 1, &decompressedData)) {
+      throw std::runtime_error("Invalid data format");
+    }
+
+    data = reinterpret_cast<const uint8_t*>(decompressedData.data());
+    length = decompressedData.size();
+  }
+
+  BufferHeader header;
+
+  if (!header.read(data, length)) {
+    throw std::runtime_error("Invalid data format");
+  }
+
+  // Every section is checked up front, the decoders below trust their lengths and counts
+  ValidateBlock(header, data);
+
+  // Decode the timestamps
+
+  const size_t begin = carrier->timestamps.size();
+
+  carrier->timestamps.resize(begin + header.itemCount);
+  carrier->timestamps.resize(begin + DecodeTimestamps(header, data, carrier->timestamps.data() + begin));
+
+  // Decode the values
+
+  if (header.valueType == MULTI_COLUMN_ENCODER) {
+    DecompressColumns(carrier, data + header.valuesOffset, header.valuesLength, header.itemCount);
+  } else {
+    carrier->columns.resize(1);
+    DecompressColumn(carrier->columns[0], header.valueType, data + header.valuesOffset, header.valuesLength,
+                     header.itemCount);
+  }
+}
+
+// Turns dictionary codes back into strings so blocks can be concatenated
+void ExpandDictionary(Column& column) {
+  if (column.dictionary.empty()) return;
+
+  std::vector<std::string>& strings = std::get<std::vector<std::string>>(column.values);
+  strings.reserve(column.dictionaryCodes.size());
+
+  for (const uint64_t code : column.dictionaryCodes) strings.push_back(column.dictionary[code]);
+
+  column.dictionary.clear();
+  column.dictionaryCodes.clear();
+}
+
+// Whether every value of a column is null
+bool IsAllNull(const Column& column) {
+  const auto& validity = column.validity;
+  return !validity.empty() && std::find(validity.begin(), validity.end(), 1) == validity.end();
+}
+
+// Replaces the values of an all null column with default values of the type of like
+void RetypeNulls(Column& column, const Values& like) {
+  const size_t size = column.validity.size();
+
+  column.dictionary.clear();
+  column.dictionaryCodes.clear();
+
+  std::visit([&](const auto& values) { column.values = std::decay_t<decltype(values)>(size); }, like);
+}
+
+// Appends a decoded block to the carrier, blocks of a series must share their columns and value types
+void AppendBlock(CompressionCarrier* carrier, CompressionCarrier& block) {
+  if (block.timestamps.empty()) return;
+
+  if (carrier->timestamps.empty()) {
+    carrier->timestamps = std::move(block.timestamps);
+    carrier->columns = std::move(block.columns);
+    carrier->multiColumn = block.multiColumn;
+    return;
+  }
+
+  if (carrier->columns.size() != block.columns.size()) {
+    throw std::runtime_error("Blocks of a series must share their columns");
+  }
+
+  for (size_t i = 0; i < carrier->columns.size(); i++) {
+    Column& column = carrier->columns[i];
+    Column& blockColumn = block.columns[i];
+
+    if (column.name != blockColumn.name) throw std::runtime_error("Blocks of a series must share their columns");
+    if (column.values.index() == blockColumn.values.index()) continue;
+
+    // Columns without any value are encoded as booleans, they take the type of the other blocks
+    if (IsAllNull(blockColumn)) {
+      RetypeNulls(blockColumn, column.values);
+    } else if (IsAllNull(column)) {
+      RetypeNulls(column, blockColumn.values);
+    } else {
+      throw std::runtime_error("Blocks of a series must share their value types");
+    }
+  }
+
+  carrier->timestamps.insert(carrier->timestamps.end(), block.timestamps.begin(), block.timestamps.end());
+
+  for (size_t i = 0; i < carrier->columns.size(); i++) {
+    Column& column = carrier->columns[i];
+    Column& blockColumn = block.columns[i];
+
+    std::visit(
+        [&](auto& values) {
+          using Vector = std::decay_t<decltype(values)>;
+
+          if constexpr (std::is_same_v<Vector, std::vector<std::string>>) {
+            ExpandDictionary(column);
+            ExpandDictionary(blockColumn);
+          }
+
+          Vector& blockValues = std::get<Vector>(blockColumn.values);
+          values.insert(values.end(), std::make_move_iterator(blockValues.begin()),
+                        std::make_move_iterator(blockValues.end()));
+        },
+        column.values);
+
+    // Blocks without nulls are all valid
+    if (!column.validity.empty() || !blockColumn.validity.empty()) {
+      column.validity.resize(carrier->timestamps.size() - block.timestamps.size(), 1);
+
+      if (blockColumn.validity.empty()) blockColumn.validity.assign(block.timestamps.size(), 1);
+      column.validity.insert(column.validity.end(), blockColumn.validity.begin(), blockColumn.validity.end());
+    }
+  }
+}
+
+// Drops the points outside of [from, to], keeping the order of the rest
+void FilterRange(CompressionCarrier* carrier) {
+  const std::vector<uint64_t>& timestamps = carrier->timestamps;
+
+  const auto compact = [&](auto& items) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < timestamps.size() && i < items.size(); i++) {
+      if (timestamps[i] < carrier->from || timestamps[i] > carrier->to) continue;
+      if (kept != i) items[kept] = std::move(items[i]);
+      kept++;
+    }
+
+    items.resize(kept);
+  };
+
+  for (auto& column : carrier->columns) {
+    if (!column.dictionary.empty()) {
+      compact(column.dictionaryCodes);
+    } else {
+      std::visit(compact, column.values);
+    }
+
+    if (!column.validity.empty()) compact(column.validity);
+  }
+
+  compact(carrier->timestamps);
+}
+
+void ExecuteDecompression(napi_env env, void* data) {
+  CompressionCarrier* carrier = static_cast<CompressionCarrier*>(data);
+
+  try {
+    if (carrier->blocks.size() == 1) {
+      DecodeBlock(carrier, carrier->blocks[0].first, carrier->blocks[0].second);
+    } else {
+      for (const auto& block : carrier->blocks) {
+        CompressionCarrier decoded;
+        decoded.selectedColumns = carrier->selectedColumns;
+
+        DecodeBlock(&decoded, block.first, block.second);
+        AppendBlock(carrier, decoded);
+      }
+    }
+  } catch (const std::exception& e) {
+    carrier->error = e.what();
+    return;
+  }
+
+  // Results without any block hold one empty column
+  if (carrier->columns.empty() && !carrier->multiColumn) carrier->columns.emplace_back();
+
+  if (carrier->hasRange) FilterRange(carrier);
+}
+
+void FinalizeEncodedData(napi_env env, void* data, void* hint) {
+  std::vector<uint8_t>* encoded = static_cast<std::vector<uint8_t>*>(hint);
+
+  int64_t adjusted;
+  napi_adjust_external_memory(env, -static_cast<int64_t>(encoded->size()), &adjusted);
+
+  delete encoded;
+}
+
+// Hands the encoded bytes to JS as an external buffer instead of copying them,
+// falling back to a copy where external buffers are not allowed
+napi_value CreateEncodedBuffer(napi_env env, std::vector<uint8_t>& compressedData) {
+  napi_value result;
+
+  std::vector<uint8_t>* encoded = new std::vector<uint8_t>(std::move(compressedData));
+
+  if (napi_create_external_buffer(env, encoded->size(), encoded->data(), FinalizeEncodedData, encoded, &result) ==
+      napi_ok) {
+    int64_t adjusted;
+    napi_adjust_external_memory(env, encoded->size(), &adjusted);
+
+    return result;
+  }
+
+  napi_create_buffer_copy(env, encoded->size(), encoded->data(), nullptr, &result);
+
+  delete encoded;
+  return result;
+}
+
+void CompressionComplete(napi_env env, napi_status status, void* data) {
+  CompressionCarrier* carrier = static_cast<CompressionCarrier*>(data);
+
+  if (carrier->targetRef) {
+    napi_delete_reference(env, carrier->targetRef);
+
+    if (carrier->compressedData.size() > carrier->targetLength) {
+      napi_value error, message;
+      napi_create_string_utf8(env, "Buffer is too small for the encoded data", NAPI_AUTO_LENGTH, &message);
+      napi_create_range_error(env, nullptr, message, &error);
+
+      napi_reject_deferred(env, carrier->deferred, error);
+    } else {
+      napi_value written;
+      napi_create_double(env, carrier->compressedData.size(), &written);
+
+      napi_resolve_deferred(env, carrier->deferred, written);
+    }
+
+    napi_delete_async_work(env, carrier->work);
+    delete carrier;
+    return;
+  }
+
+  StageTimer outputTimer(STAGE_OUTPUT, carrier->timestamps.size(), carrier->compressedData.size());
+
+  napi_value result = CreateEncodedBuffer(env, carrier->compressedData);
+
+  outputTimer.stop();
+
+  napi_resolve_deferred(env, carrier->deferred, result);
+  napi_delete_async_work(env, carrier->work);
+  delete carrier;
+}
+
+// Creates the JS array of a decoded column
+napi_value CreateValuesArray(napi_env env, Column& column, bool typedArrays) {
+  napi_value valuesArray;
+
+  switch (getVariantType(column.values)) {
+    case VariantType::Int64:
+      // Handle int64_t
+      napi_create_array(env, &valuesArray);
+      break;
+    case VariantType::Double: {
+      std::vector<double>& doubleVector = std::get<std::vector<double>>(column.values);
+      napi_create_array_with_length(env, doubleVector.size(), &valuesArray);
+
+      for (uint32_t i = 0; i < doubleVector.size(); i++) {
+        napi_value num;
+        napi_create_double(env, doubleVector[i], &num);
+        napi_set_element(env, valuesArray, i, num);
+      }
+
+      break;
+    }
+    case VariantType::Float32: {
+      std::vector<float>& floatVector = std::get<std::vector<float>>(column.values);
+
+      if (typedArrays && column.validity.empty()) {
+        napi_value arrayBuffer;
+        void* arrayData;
+
+        napi_create_arraybuffer(env, floatVector.size() * sizeof(float), &arrayData, &arrayBuffer);
+        std::copy(floatVector.begin(), floatVector.end(), static_cast<float*>(arrayData));
+        napi_create_typedarray(env, napi_float32_array, floatVector.size(), arrayBuffer, 0, &valuesArray);
+        break;
+      }
+
+      napi_create_array_with_length(env, floatVector.size(), &valuesArray);
+
+      for (uint32_t i = 0; i < floatVector.size(); i++) {
+        napi_value num;
+        napi_create_double(env, floatVector[i], &num);
+        napi_set_element(env, valuesArray, i, num);
+      }
+
+      break;
+    }
+    case VariantType::Bool: {
+      std::vector<uint8_t>& boolVector = std::get<std::vector<uint8_t>>(column.values);
+
+      if (typedArrays && column.validity.empty()) {
+        napi_value arrayBuffer;
+        void* arrayData;
+
+        napi_create_arraybuffer(env, boolVector.size(), &arrayData, &arrayBuffer);
+        std::copy(boolVector.begin(), boolVector.end(), static_cast<uint8_t*>(arrayData));
+        napi_create_typedarray(env, napi_uint8_array, boolVector.size(), arrayBuffer, 0, &valuesArray);
+        break;
+      }
+
+      napi_value booleans[2];
+      napi_get_boolean(env, false, &booleans[0]);
+      napi_get_boolean(env, true, &booleans[1]);
+
+      napi_create_array_with_length(env, boolVector.size(), &valuesArray);
+
+      for (uint32_t i = 0; i < boolVector.size(); i++) {
+        napi_set_element(env, valuesArray, i, booleans[boolVector[i]]);
+      }
+      break;
+    }
+    case VariantType::String: {
+      if (!column.dictionary.empty()) {
+        // Create one JS string per dictionary entry and share it between elements
+        std::vector<napi_value> entries(column.dictionary.size());
+
+        for (size_t i = 0; i < column.dictionary.size(); i++) {
+          napi_create_string_utf8(env, column.dictionary[i].data(), column.dictionary[i].size(), &entries[i]);
+        }
+
+        napi_create_array_with_length(env, column.dictionaryCodes.size(), &valuesArray);
+
+        for (uint32_t i = 0; i < column.dictionaryCodes.size(); i++) {
+          napi_set_element(env, valuesArray, i, entries[column.dictionaryCodes[i]]);
+        }
+
+        break;
+      }
+
+      std::vector<std::string>& stringVector = std::get<std::vector<std::string>>(column.values);
+      napi_create_array_with_length(env, stringVector.size(), &valuesArray);
+
+      for (uint32_t i = 0; i < stringVector.size(); i++) {
+        napi_value str;
+        napi_create_string_utf8(env, stringVector[i].c_str(), NAPI_AUTO_LENGTH, &str);
+
+        napi_set_element(env, valuesArray, i, str);
+      }
+
+      break;
+    }
+  }
+
+  if (!column.validity.empty()) {
+    napi_value null;
+    napi_get_null(env, &null);
+
+    for (uint32_t i = 0; i < column.validity.size(); i++) {
+      if (!column.validity[i]) napi_set_element(env, valuesArray, i, null);
+    }
+  }
+
+  return valuesArray;
+}
+
+void DecompressionComplete(napi_env env, napi_status status, void* data) {
+  CompressionCarrier* carrier = static_cast<CompressionCarrier*>(data);
+
+  if (!carrier->error.empty()) {
+    napi_value message, error;
+    napi_create_string_utf8(env, carrier->error.c_str(), NAPI_AUTO_LENGTH, &message);
+    napi_create_error(env, nullptr, message, &error);
+    napi_reject_deferred(env, carrier->deferred, error);
+    napi_delete_async_work(env, carrier->work);
+
+    delete carrier;
+    return;
+  }
+
+  StageTimer resultTimer(STAGE_RESULT_BUILD, carrier->timestamps.size(), [&] { return RawByteSize(carrier); });
+
+  napi_value result, timestampsArray;
+
+  // Create the result object
+  napi_create_object(env, &result);
+
+  // Assuming timestamps are stored in carrier->timestamps, create the
+  // timestamps array
+  napi_create_array_with_length(env, carrier->timestamps.size(), &timestampsArray);
+  for (uint32_t i = 0; i < carrier->timestamps.size(); i++) {
+    napi_value num;
+    napi_create_double(env, carrier->timestamps[i], &num);
+    napi_set_element(env, timestampsArray, i, num);
+  }
+
+  // Set the timestamps property on the result object
+  napi_set_named_property(env, result, "timestamps", timestampsArray);
+
+  if (carrier->multiColumn) {
+    napi_value columns;
+    napi_create_object(env, &columns);
+
+    for (auto& column : carrier->columns) {
+      napi_value name;
+      napi_create_string_utf8(env, column.name.data(), column.name.size(), &name);
+      napi_set_property(env, columns, name, CreateValuesArray(env, column, carrier->typedArrays));
+    }
+
+    napi_set_named_property(env, result, "columns", columns);
+  } else {
+    // Set the values property on the result object
+    napi_set_named_property(env, result, "values", CreateValuesArray(env, carrier->columns[0], carrier->typedArrays));
+  }
+
+  resultTimer.stop();
+
+  napi_resolve_deferred(env, carrier->deferred, result);
+  napi_delete_async_work(env, carrier->work);
+
+  delete carrier;
+}
+
+// Records a null at index i, values keep a placeholder in its slot
+void MarkNull(Column& column, uint32_t i) {
+  column.validity.resize(i, 1);
+  column.validity.push_back(0);
+}
+
+bool IsNull(napi_valuetype type) { return type == napi_null || type == napi_undefined; }
+
+// Reads a values array or Uint8Array into a column, throws a JS error and
+// returns false when it does not hold expectedLength values of one type.
+// null and undefined elements are stored as nulls
+bool ReadColumn(napi_env env, napi_value valuesValue, uint32_t expectedLength, Column& column) {
+  bool isValuesArray, isValuesTypedArray;
+  napi_is_array(env, valuesValue, &isValuesArray);
+  napi_is_typedarray(env, valuesValue, &isValuesTypedArray);
+
+  if (!(isValuesArray || isValuesTypedArray)) {
+    napi_throw_type_error(env, nullptr, "Both timestamps and values must be arrays");
+    return false;
+  }
+
+  uint32_t numValues;
+  napi_typedarray_type typedArrayType = napi_uint8_array;
+  void* typedArrayData = nullptr;
+
+  if (isValuesTypedArray) {
+    size_t typedArrayLength;
+    napi_get_typedarray_info(env, valuesValue, &typedArrayType, &typedArrayLength, &typedArrayData, nullptr, nullptr);
+    numValues = typedArrayLength;
+
+    // Uint8Array values are read as booleans and Float32Array values as single precision floats
+    if (typedArrayType != napi_uint8_array && typedArrayType != napi_float32_array) {
+      napi_throw_type_error(env, nullptr, "Unsupported typed array type");
+      return false;
+    }
+  } else {
+    napi_get_array_length(env, valuesValue, &numValues);
+  }
+
+  if (expectedLength != numValues) {
+    napi_throw_type_error(env, nullptr, "Both timestamps and values must be arrays of the same length");
+    return false;
+  }
+
+  // Read the array elements from JavaScript and store them in a vector
+
+  napi_valuetype valuetype;
+  napi_value firstElement;
+
+  if (isValuesTypedArray && typedArrayType == napi_float32_array) {
+    const float* floats = static_cast<const float*>(typedArrayData);
+
+    column.values = std::vector<float>(floats, floats + numValues);
+    valuetype = napi_undefined;
+  } else if (isValuesTypedArray) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(typedArrayData);
+
+    column.values = std::vector<uint8_t>(numValues);
+    std::vector<uint8_t>& booleans = std::get<std::vector<uint8_t>>(column.values);
+
+    std::transform(bytes, bytes + numValues, booleans.begin(), [](uint8_t x) { return x != 0; });
+    valuetype = napi_undefined;
+  } else {
+    // The first non-null element gives the type, with a dummy type for empty or all null arrays
+    valuetype = napi_boolean;
+
+    for (uint32_t i = 0; i < numValues; i++) {
+      napi_valuetype elementType;
+      napi_get_element(env, valuesValue, i, &firstElement);
+      napi_typeof(env, firstElement, &elementType);
+
+      if (!IsNull(elementType)) {
+        valuetype = elementType;
+        break;
+      }
+    }
+  }
+
+  switch (valuetype) {
+    case napi_number: {
+      column.values = std::vector<double>{};
+
+      std::vector<double>& numbers = std::get<std::vector<double>>(column.values);
+      numbers.reserve(numValues);
+
+      for (uint32_t i = 0; i < numValues; i++) {
+        napi_value element;
+        napi_get_element(env, valuesValue, i, &element);
+
+        napi_valuetype itemType;
+        napi_typeof(env, element, &itemType);
+
+        if (IsNull(itemType)) {
+          MarkNull(column, i);
+          numbers.push_back(0);
+          continue;
+        }
+
+        // Throw if not a number
+        if (itemType != napi_number) {
+          napi_throw_type_error(env, nullptr, "Values must all be numbers");
+          return false;
+        }
+
+        double num;
+        napi_get_value_double(env, element, &num);
+        numbers.push_back(num);
+      }
+      break;
+    }
+    case napi_bigint: {
+      column.values = std::vector<int64_t>{};
+
+      std::vector<int64_t>& numbers = std::get<std::vector<int64_t>>(column.values);
+      numbers.reserve(numValues);
+
+      for (uint32_t i = 0; i < numValues; i++) {
+        napi_value element;
+        napi_get_element(env, valuesValue, i, &element);
+
+        // Throw if not a napi_bigint
+        napi_valuetype itemType;
+        napi_typeof(env, element, &itemType);
+
+        if (IsNull(itemType)) {
+          MarkNull(column, i);
+          numbers.push_back(0);
+          continue;
+        }
+
+        if (itemType != napi_bigint) {
+          napi_throw_type_error(env, nullptr, "Values must all be bigints");
+          return false;
+        }
+
+        int64_t num;
         napi_get_value_bigint_int64(env, element, &num,
                                     nullptr);  // this might require bigint support
         numbers.push_back(num);
       }
       break;
     }
-    case napi_boolean: {
-      carrier->values = std::vector<bool>{};
+    case napi_boolean: {
+      column.values = std::vector<uint8_t>{};
+
+      std::vector<uint8_t>& numbers = std::get<std::vector<uint8_t>>(column.values);
+      numbers.reserve(numValues);
+
+      for (uint32_t i = 0; i < numValues; i++) {
+        napi_value element;
+        napi_get_element(env, valuesValue, i, &element);
+
+        // Throw if not a napi_boolean
+        napi_valuetype itemType;
+        napi_typeof(env, element, &itemType);
+
+        if (IsNull(itemType)) {
+          MarkNull(column, i);
+          numbers.push_back(false);
+          continue;
+        }
+
+        if (itemType != napi_boolean) {
+          napi_throw_type_error(env, nullptr, "Values must all be boolean");
+          return false;
+        }
+
+        bool num;
+        napi_get_value_bool(env, element, &num);
+        numbers.push_back(num);
+      }
+      break;
+    }
+    case napi_string: {
+      column.values = std::vector<std::string>{};
+
+      std::vector<std::string>& strings = std::get<std::vector<std::string>>(column.values);
+      strings.reserve(numValues);
+
+      for (uint32_t i = 0; i < numValues; i++) {
+        napi_value element;
+        napi_get_element(env, valuesValue, i, &element);
+
+        // Throw if not a napi_boolean
+        napi_valuetype itemType;
+        napi_typeof(env, element, &itemType);
+
+        if (IsNull(itemType)) {
+          MarkNull(column, i);
+          strings.emplace_back();
+          continue;
+        }
+
+        if (itemType != napi_string) {
+          napi_throw_type_error(env, nullptr, "Values must all be strings");
+          return false;
+        }
+
+        size_t str_length;
+        napi_get_value_string_utf8(env, element, nullptr, 0, &str_length);
+
+        std::string str(str_length, '\0');
+        napi_get_value_string_utf8(env, element, &str[0], str_length + 1, &str_length);
+
+        strings.push_back(str);
+      }
+      break;
+    }
+    case napi_undefined:
+      // Already read from a typed array
+      break;
+    default:
+      napi_throw_type_error(env, nullptr, "Unsupported data type in the array");
+      return false;
+  }
+
+  if (!column.validity.empty()) column.validity.resize(numValues, 1);
+
+  return true;
+}
+
+// Reads a JS string argument, false if the value is not a string
+bool GetString(napi_env env, napi_value value, std::string& out) {
+  size_t length;
+  if (napi_get_value_string_utf8(env, value, nullptr, 0, &length) != napi_ok) return false;
+
+  out.assign(length, '\0');
+  napi_get_value_string_utf8(env, value, &out[0], length + 1, &length);
+
+  return true;
+}
+
+// Reads the { sampleSize, highRatio } options of the encode functions, or throws and returns false
+bool ReadEncodeOptions(napi_env env, napi_value options, EncodeOptions& out) {
+  napi_valuetype optionsType = napi_undefined;
+  if (options) napi_typeof(env, options, &optionsType);
+
+  if (optionsType != napi_object) return true;
+
+  bool hasProperty;
+  napi_value value;
+
+  napi_has_named_property(env, options, "sampleSize", &hasProperty);
+
+  if (hasProperty) {
+    napi_get_named_property(env, options, "sampleSize", &value);
+
+    if (napi_get_value_uint32(env, value, &out.sampleSize) != napi_ok) {
+      napi_throw_type_error(env, nullptr, "sampleSize must be a number");
+      return false;
+    }
+  }
+
+  napi_has_named_property(env, options, "highRatio", &hasProperty);
+
+  if (hasProperty) {
+    napi_get_named_property(env, options, "highRatio", &value);
+
+    if (napi_get_value_bool(env, value, &out.highRatio) != napi_ok) {
+      napi_throw_type_error(env, nullptr, "highRatio must be a boolean");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Reads { timestamps, values } or { timestamps, columns } and the encoding
+// options into a new carrier, or throws and returns nullptr
+CompressionCarrier* ReadEncodeInput(napi_env env, napi_value input, napi_value options) {
+  // Check if the first argument is an object
+  // Check the type of the argument
+  napi_valuetype argType;
+  napi_typeof(env, input, &argType);
+
+  if (argType != napi_object) {
+    napi_throw_type_error(env, nullptr, "Argument must be an object");
+    return nullptr;
+  }
+
+  napi_value timestampsValue, columnsValue;
+  napi_get_named_property(env, input, "timestamps", &timestampsValue);
+
+  // Columns sharing the timestamps are passed as { columns: { name: values } }
+  bool hasColumns;
+  napi_has_named_property(env, input, "columns", &hasColumns);
+
+  napi_valuetype columnsType = napi_undefined;
+
+  if (hasColumns) {
+    napi_get_named_property(env, input, "columns", &columnsValue);
+    napi_typeof(env, columnsValue, &columnsType);
+  }
+
+  // Check if the timestamps property is an array
+  bool isTimestampsArray;
+  napi_is_array(env, timestampsValue, &isTimestampsArray);
+  if (!isTimestampsArray) {
+    napi_throw_type_error(env, nullptr, "Both timestamps and values must be arrays");
+    return nullptr;
+  }
+
+  uint32_t numTimestampValues;
+  napi_get_array_length(env, timestampsValue, &numTimestampValues);
+
+  CompressionCarrier* carrier = new CompressionCarrier;
+
+  if (!ReadEncodeOptions(env, options, carrier->options)) {
+    delete carrier;
+    return nullptr;
+  }
+
+  StageTimer marshalTimer(STAGE_MARSHAL, numTimestampValues);
+
+  // Read the array elements from JavaScript and store them in a vector
+
+  carrier->timestamps.reserve(numTimestampValues);
+
+  for (uint32_t i = 0; i < numTimestampValues; i++) {
+    napi_value element;
+    napi_get_element(env, timestampsValue, i, &element);
+
+    double num_double;
+    napi_get_value_double(env, element, &num_double);
+    uint64_t num = static_cast<uint64_t>(num_double);
+    carrier->timestamps.push_back(num);
+  }
+
+  if (hasColumns) {
+    bool isColumnsArray;
+    napi_is_array(env, columnsValue, &isColumnsArray);
+
+    napi_value names;
+    uint32_t numColumns = 0;
+
+    if (columnsType == napi_object && !isColumnsArray) {
+      napi_get_property_names(env, columnsValue, &names);
+      napi_get_array_length(env, names, &numColumns);
+    }
+
+    if (numColumns == 0) {
+      delete carrier;
+      napi_throw_type_error(env, nullptr, "Columns must be an object of value arrays");
+      return nullptr;
+    }
+
+    carrier->multiColumn = true;
+    carrier->columns.resize(numColumns);
+
+    for (uint32_t i = 0; i < numColumns; i++) {
+      napi_value name, valuesValue;
+      napi_get_element(env, names, i, &name);
+      napi_get_property(env, columnsValue, name, &valuesValue);
+
+      napi_value nameString;
+      napi_coerce_to_string(env, name, &nameString);
+      GetString(env, nameString, carrier->columns[i].name);
+
+      if (!ReadColumn(env, valuesValue, numTimestampValues, carrier->columns[i])) {
+        delete carrier;
+        return nullptr;
+      }
+    }
+  } else {
+    napi_value valuesValue;
+    napi_get_named_property(env, input, "values", &valuesValue);
+
+    carrier->columns.resize(1);
+
+    if (!ReadColumn(env, valuesValue, numTimestampValues, carrier->columns[0])) {
+      delete carrier;
+      return nullptr;
+    }
+  }
+
+  marshalTimer.setBytes([&] { return RawByteSize(carrier); });
+  marshalTimer.stop();
+
+  return carrier;
+}
+
+napi_value QueueCompression(napi_env env, CompressionCarrier* carrier) {
+  napi_value promise;
+  napi_value asyncNameString;
+
+  napi_create_string_utf8(env, "encode", NAPI_AUTO_LENGTH, &asyncNameString);
+
+  napi_create_promise(env, &carrier->deferred, &promise);
+  napi_create_async_work(env, nullptr, asyncNameString, ExecuteCompression, CompressionComplete, carrier,
+                         &carrier->work);
+  napi_queue_async_work(env, carrier->work);
+
+  return promise;
+}
+
+napi_value Encode(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+  CompressionCarrier* carrier = ReadEncodeInput(env, args[0], argc > 1 ? args[1] : nullptr);
+  if (!carrier) return nullptr;
+
+  return QueueCompression(env, carrier);
+}
+
+// Encodes into a caller owned buffer starting at offset, and resolves with the
+// number of bytes written. Rejects with a RangeError if they do not fit
+napi_value EncodeInto(napi_env env, napi_callback_info info) {
+  size_t argc = 4;
+  napi_value args[4];
+  napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+  bool isBuffer = false;
+  if (argc > 1) napi_is_buffer(env, args[1], &isBuffer);
+
+  if (!isBuffer) {
+    napi_throw_type_error(env, nullptr, "Second argument must be a buffer");
+    return nullptr;
+  }
+
+  uint8_t* target;
+  size_t targetLength;
+  napi_get_buffer_info(env, args[1], (void**)&target, &targetLength);
+
+  uint32_t offset = 0;
+
+  if (argc > 2) {
+    napi_valuetype offsetType;
+    napi_typeof(env, args[2], &offsetType);
+
+    if (offsetType != napi_undefined && napi_get_value_uint32(env, args[2], &offset) != napi_ok) {
+      napi_throw_type_error(env, nullptr, "offset must be a number");
+      return nullptr;
+    }
+  }
+
+  if (offset > targetLength) {
+    napi_throw_range_error(env, nullptr, "offset is outside of the buffer");
+    return nullptr;
+  }
+
+  CompressionCarrier* carrier = ReadEncodeInput(env, args[0], argc > 3 ? args[3] : nullptr);
+  if (!carrier) return nullptr;
+
+  // The reference keeps the target alive while it is written from the thread pool
+  carrier->target = target + offset;
+  carrier->targetLength = targetLength - offset;
+  napi_create_reference(env, args[1], 1, &carrier->targetRef);
+
+  return QueueCompression(env, carrier);
+}
+
+// Returns an upper bound of the size encode would produce for the data
+napi_value EncodeBound(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+  CompressionCarrier* carrier = ReadEncodeInput(env, args[0], nullptr);
+  if (!carrier) return nullptr;
+
+  napi_value result;
+  napi_create_double(env, MaxEncodedSize(carrier), &result);
+
+  delete carrier;
+  return result;
+}
+
+// Reads the { typedArrays, from, to, columns } options shared by the decode functions
+void ReadDecodeOptions(napi_env env, napi_value options, CompressionCarrier* carrier) {
+  napi_valuetype optionsType;
+  napi_typeof(env, options, &optionsType);
+
+  if (optionsType != napi_object) return;
+
+  bool hasProperty;
+  napi_value value;
+
+  napi_has_named_property(env, options, "typedArrays", &hasProperty);
+
+  if (hasProperty) {
+    napi_get_named_property(env, options, "typedArrays", &value);
+    napi_get_value_bool(env, value, &carrier->typedArrays);
+  }
+
+  napi_has_named_property(env, options, "columns", &hasProperty);
+
+  if (hasProperty) {
+    napi_get_named_property(env, options, "columns", &value);
+
+    bool isArray;
+    napi_is_array(env, value, &isArray);
+
+    uint32_t count = 0;
+    if (isArray) napi_get_array_length(env, value, &count);
+
+    for (uint32_t i = 0; i < count; i++) {
+      napi_value name;
+      napi_get_element(env, value, i, &name);
+
+      std::string column;
+      if (GetString(env, name, column)) carrier->selectedColumns.push_back(column);
+    }
+  }
+
+  double bound;
+
+  napi_has_named_property(env, options, "from", &hasProperty);
+
+  if (hasProperty) {
+    napi_get_named_property(env, options, "from", &value);
+
+    if (napi_get_value_double(env, value, &bound) == napi_ok) {
+      carrier->hasRange = true;
+      carrier->from = bound > 0 ? static_cast<uint64_t>(bound) : 0;
+    }
+  }
+
+  napi_has_named_property(env, options, "to", &hasProperty);
+
+  if (hasProperty) {
+    napi_get_named_property(env, options, "to", &value);
+
+    if (napi_get_value_double(env, value, &bound) == napi_ok) {
+      carrier->hasRange = true;
+      carrier->to = !(bound > 0) ? 0 : bound >= 18446744073709551616.0 ? UINT64_MAX : static_cast<uint64_t>(bound);
+    }
+  }
+}
+
+napi_value QueueDecompression(napi_env env, CompressionCarrier* carrier) {
+  napi_value promise;
+  napi_value asyncNameString;
+
+  napi_create_string_utf8(env, "decode", NAPI_AUTO_LENGTH, &asyncNameString);
+
+  napi_create_promise(env, &carrier->deferred, &promise);
+  napi_create_async_work(env, nullptr, asyncNameString, ExecuteDecompression, DecompressionComplete, carrier,
+                         &carrier->work);
+  napi_queue_async_work(env, carrier->work);
+
+  return promise;
+}
+
+napi_value Decode(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+  // Check if the first argument is a buffer
+  bool isBuffer;
+  napi_is_buffer(env, args[0], &isBuffer);
+  if (!isBuffer) {
+    napi_throw_type_error(env, nullptr, "First argument must be a buffer");
+    return nullptr;
+  }
+
+  // Get buffer data
+  CompressionCarrier* carrier = new CompressionCarrier;
+  size_t bufferLength;
+  uint8_t* data = NULL;
+
+  napi_get_buffer_info(env, args[0], (void**)&data, &bufferLength);
+
+  if (argc > 1) ReadDecodeOptions(env, args[1], carrier);
+
+  StageTimer copyTimer(STAGE_INPUT_COPY, 0, bufferLength);
+
+  carrier->compressedData.resize(bufferLength);
+  std::copy(data, data + bufferLength, carrier->compressedData.begin());
+
+  copyTimer.stop();
+
+  carrier->blocks.emplace_back(carrier->compressedData.data(), carrier->compressedData.size());
+
+  return QueueDecompression(env, carrier);
+}
+
+// Decodes the present values of a nullable section with decode(valueType, values, length, count, out) into
+// the tail of out, then moves them forward to their positions, which never
+// overtakes the unread ones, and fills the nulls with NaN
+template <class T, class F>
+void DecodeNullableInto(const uint8_t* values, size_t valuesLength, uint32_t itemCount, T* out, F decode) {
+  Slice buffer(values, valuesLength);
+
+  const uint32_t validityLength = buffer.read<uint32_t>();
+  Slice validitySlice = buffer.getSlice(validityLength);
+
+  // Reused by later decodes on the thread, so decodeInto does not allocate once it has grown. Sections nested in
+  // a nullable section are never nullable themselves (see ValidateValues), so this is never reentered
+  thread_local std::vector<uint8_t> validity;
+  validity.resize(itemCount);
+  BooleanEncoder::decode(validitySlice, validity.data(), itemCount);
+
+  const uint32_t presentCount = std::count(validity.begin(), validity.begin() + itemCount, 1);
+  const uint8_t valueType = buffer.read<uint8_t>();
+
+  ValidateValues(valueType, values + buffer.offset, buffer.bytesLeft(), presentCount);
+
+  const uint32_t gap = itemCount - presentCount;
+  decode(valueType, values + buffer.offset, buffer.bytesLeft(), presentCount, out + gap);
+
+  for (uint32_t i = 0, j = gap; i < itemCount; i++) {
+    out[i] = validity[i] ? out[j++] : std::numeric_limits<T>::quiet_NaN();
+  }
+}
+
+// Decodes a float values section straight into out, nulls are written as NaN
+void DecodeFloatsInto(uint8_t compressionType, const uint8_t* values, size_t valuesLength, uint32_t itemCount,
+                      double* out) {
+  switch (compressionType) {
+    case FLOAT_ENCODER: {
+      Slice buffer(values, valuesLength);
+      FloatEncoder::decode(buffer, out, itemCount);
+      break;
+    }
+    case FLOAT_RAW_ENCODER: {
+      Slice buffer(values, valuesLength);
+      FloatEncoder::decodeRaw(buffer, out, itemCount);
+      break;
+    }
+    case FLOAT_SNAPPY_ENCODER: {
+      Slice buffer(values, valuesLength);
+      FloatEncoder::decodeSnappy(buffer, out, itemCount);
+      break;
+    }
+    case FLOAT_ENTROPY_ENCODER: {
+      Slice buffer(values, valuesLength);
+      FloatEncoder::decodeEntropy(buffer, out, itemCount);
+      break;
+    }
+    case FLOAT_FPC_ENCODER: {
+      Slice buffer(values, valuesLength);
+      FloatEncoder::decodeFpc(buffer, out, itemCount);
+      break;
+    }
+    case FLOAT_SHUFFLE_ENCODER: {
+      Slice buffer(values, valuesLength);
+      FloatEncoder::decodeShuffle(buffer, out, itemCount);
+      break;
+    }
+    case FLOAT_RUNS_ENCODER: {
+      Slice buffer(values, valuesLength);
+      FloatEncoder::decodeRuns(buffer, out, itemCount);
+      break;
+    }
+    case FLOAT_INTEGER_ENCODER: {
+      Slice buffer(values, valuesLength);
+      FloatEncoder::decodeIntegers(buffer, out, itemCount);
+      break;
+    }
+    case FLOAT32_ENCODER: {
+      Slice buffer(values, valuesLength);
+
+      // The floats are decoded into the upper half of out and widened forward,
+      // each double only overwrites floats that were already read
+      float* floats = reinterpret_cast<float*>(out) + itemCount;
+      FloatEncoder::decode32(buffer, floats, itemCount);
+
+      for (uint32_t i = 0; i < itemCount; i++) {
+        float value;
+        std::memcpy(&value, floats + i, sizeof(value));
+
+        const double widened = value;
+        std::memcpy(out + i, &widened, sizeof(widened));
+      }
+      break;
+    }
+    case NULLABLE_ENCODER: {
+      DecodeNullableInto(values, valuesLength, itemCount, out, DecodeFloatsInto);
+      break;
+    }
+    default: {
+      throw std::invalid_argument("Values are not floats, decode them into a Float64Array");
+    }
+  }
+}
 
-      std::vector<bool>& numbers = std::get<std::vector<bool>>(carrier->values);
-      numbers.reserve(numValues);
+// Decodes a single precision values section straight into out
+void DecodeFloats32Into(uint8_t compressionType, const uint8_t* values, size_t valuesLength, uint32_t itemCount,
+                        float* out) {
+  switch (compressionType) {
+    case FLOAT32_ENCODER: {
+      Slice buffer(values, valuesLength);
+      FloatEncoder::decode32(buffer, out, itemCount);
+      break;
+    }
+    case NULLABLE_ENCODER: {
+      DecodeNullableInto(values, valuesLength, itemCount, out, DecodeFloats32Into);
+      break;
+    }
+    default: {
+      throw std::invalid_argument("Values are not single precision floats, decode them into a Float64Array");
+    }
+  }
+}
 
-      for (uint32_t i = 0; i < numValues; i++) {
-        napi_value element;
-        napi_get_element(env, valuesValue, i, &element);
+// Decodes a boolean values section straight into out, one byte per value
+void DecodeBooleansInto(uint8_t compressionType, const uint8_t* values, size_t valuesLength, uint32_t itemCount,
+                        uint8_t* out) {
+  switch (compressionType) {
+    case BOOLEAN_HYBRID_ENCODER: {
+      Slice buffer(values, valuesLength);
+      BooleanEncoder::decode(buffer, out, itemCount);
+      break;
+    }
+    case BOOLEAN_ENCODER: {
+      Column column;
+      DecompressBoolean(column, values, valuesLength);
+
+      const std::vector<uint8_t>& decoded = std::get<std::vector<uint8_t>>(column.values);
+      std::copy_n(decoded.begin(), std::min<size_t>(decoded.size(), itemCount), out);
+      break;
+    }
+    default: {
+      throw std::invalid_argument("Values are not booleans, decode them into a Uint8Array");
+    }
+  }
+}
+
+// Returns the data and element count of a typed array of the given types, or false
+bool GetTypedArray(napi_env env, napi_value value, std::initializer_list<napi_typedarray_type> types, void*& data,
+                   size_t& length, napi_typedarray_type& type) {
+  bool isTypedArray;
+  napi_is_typedarray(env, value, &isTypedArray);
+  if (!isTypedArray) return false;
+
+  napi_get_typedarray_info(env, value, &type, &length, &data, nullptr, nullptr);
+
+  return std::find(types.begin(), types.end(), type) != types.end();
+}
+
+// Decodes synchronously into caller owned typed arrays, starting at offset, and
+// returns the number of points written. Float and boolean values only
+napi_value DecodeInto(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+  bool isBuffer;
+  napi_is_buffer(env, args[0], &isBuffer);
+  if (!isBuffer) {
+    napi_throw_type_error(env, nullptr, "First argument must be a buffer");
+    return nullptr;
+  }
+
+  napi_valuetype targetsType = napi_undefined;
+  if (argc > 1) napi_typeof(env, args[1], &targetsType);
+
+  if (targetsType != napi_object) {
+    napi_throw_type_error(env, nullptr, "Second argument must be an object of target arrays");
+    return nullptr;
+  }
+
+  size_t bufferLength;
+  uint8_t* data = NULL;
+
+  napi_get_buffer_info(env, args[0], (void**)&data, &bufferLength);
+
+  bool hasProperty;
+  napi_value value;
+
+  void* timestampsData = nullptr;
+  size_t timestampsLength = 0;
+  napi_typedarray_type timestampsType = napi_float64_array;
+
+  napi_has_named_property(env, args[1], "timestamps", &hasProperty);
+
+  if (hasProperty) {
+    napi_get_named_property(env, args[1], "timestamps", &value);
+
+    if (!GetTypedArray(env, value, {napi_float64_array, napi_bigint64_array, napi_biguint64_array}, timestampsData,
+                       timestampsLength, timestampsType)) {
+      napi_throw_type_error(env, nullptr, "timestamps must be a Float64Array, BigInt64Array or BigUint64Array");
+      return nullptr;
+    }
+  }
+
+  void* valuesData = nullptr;
+  size_t valuesLength = 0;
+  napi_typedarray_type valuesType = napi_float64_array;
+
+  napi_has_named_property(env, args[1], "values", &hasProperty);
+
+  if (hasProperty) {
+    napi_get_named_property(env, args[1], "values", &value);
+
+    if (!GetTypedArray(env, value, {napi_float64_array, napi_float32_array, napi_uint8_array}, valuesData, valuesLength,
+                       valuesType)) {
+      napi_throw_type_error(env, nullptr, "values must be a Float64Array, Float32Array or Uint8Array");
+      return nullptr;
+    }
+  }
+
+  uint32_t offset = 0;
+
+  napi_has_named_property(env, args[1], "offset", &hasProperty);
+
+  if (hasProperty) {
+    napi_get_named_property(env, args[1], "offset", &value);
+
+    napi_valuetype offsetType;
+    napi_typeof(env, value, &offsetType);
+
+    if (offsetType != napi_undefined && napi_get_value_uint32(env, value, &offset) != napi_ok) {
+      napi_throw_type_error(env, nullptr, "offset must be a number");
+      return nullptr;
+    }
+  }
+
+  std::string column;
+
+  napi_has_named_property(env, args[1], "column", &hasProperty);
+
+  if (hasProperty) {
+    napi_get_named_property(env, args[1], "column", &value);
+    GetString(env, value, column);
+  }
+
+  std::string decompressedData;
+
+  if (bufferLength > 0 && data[0] == SNAPPY) {
+    StageTimer snappyTimer(STAGE_SNAPPY, 0, bufferLength);
+
+    if (!snappy::Uncompress(reinterpret_cast<const char*>(data) + 1, bufferLength - 1, &decompressedData)) {
+      napi_throw_error(env, nullptr, "Invalid data format");
+      return nullptr;
+    }
+
+    data = reinterpret_cast<uint8_t*>(&decompressedData[0]);
+    bufferLength = decompressedData.size();
+  }
+
+  BufferHeader header;
+
+  if (!header.read(data, bufferLength)) {
+    napi_throw_error(env, nullptr, "Invalid data format");
+    return nullptr;
+  }
+
+  const auto fits = [&](void* target, size_t length) {
+    return !target || (offset <= length && length - offset >= header.itemCount);
+  };
 
-        // Throw if not a napi_boolean
-        napi_valuetype itemType;
-        napi_typeof(env, element, &itemType);
+  if (!fits(timestampsData, timestampsLength) || !fits(valuesData, valuesLength)) {
+    napi_throw_range_error(env, nullptr, "Target arrays are too small for the decoded points");
+    return nullptr;
+  }
 
-        if (itemType != napi_boolean) {
-          napi_throw_type_error(env, nullptr, "Values must all be boolean");
-          return nullptr;
-        }
+  // Find the section of the requested column, or the only one
+  uint8_t valueType = header.valueType;
+  const uint8_t* valuesSection = data + header.valuesOffset;
+  size_t valuesSectionLength = header.valuesLength;
 
-        bool num;
-        napi_get_value_bool(env, element, &num);
-        numbers.push_back(num);
-      }
-      break;
+  if (header.valueType == MULTI_COLUMN_ENCODER && valuesData) {
+    ColumnDirectory directory;
+
+    if (!directory.read(valuesSection, valuesSectionLength)) {
+      napi_throw_error(env, nullptr, "Invalid data format");
+      return nullptr;
     }
-    case napi_string: {
-      carrier->values = std::vector<std::string>{};
 
-      std::vector<std::string>& strings = std::get<std::vector<std::string>>(carrier->values);
-      strings.reserve(numValues);
+    const auto entry = std::find_if(directory.columns.begin(), directory.columns.end(),
+                                    [&](const ColumnDirectory::Entry& entry) { return entry.name == column; });
 
-      for (uint32_t i = 0; i < numValues; i++) {
-        napi_value element;
-        napi_get_element(env, valuesValue, i, &element);
+    if (entry == directory.columns.end()) {
+      napi_throw_error(env, nullptr, "column must name one of the buffer's columns");
+      return nullptr;
+    }
 
-        // Throw if not a napi_boolean
-        napi_valuetype itemType;
-        napi_typeof(env, element, &itemType);
+    valueType = entry->valueType;
+    valuesSection += entry->valuesOffset;
+    valuesSectionLength = entry->valuesLength;
+  }
 
-        if (itemType != napi_string) {
-          napi_throw_type_error(env, nullptr, "Values must all be strings");
-          return nullptr;
-        }
+  try {
+    ValidateBlock(header, data);
 
-        size_t str_length;
-        napi_get_value_string_utf8(env, element, nullptr, 0, &str_length);
+    if (timestampsData) {
+      uint64_t* timestamps = static_cast<uint64_t*>(timestampsData) + offset;
+      DecodeTimestamps(header, data, timestamps);
 
-        std::string str(str_length, '\0');
-        napi_get_value_string_utf8(env, element, &str[0], str_length + 1, &str_length);
+      // Float64Array targets are converted in place, both elements are 8 bytes
+      if (timestampsType == napi_float64_array) {
+        for (uint32_t i = 0; i < header.itemCount; i++) {
+          uint64_t timestamp;
+          std::memcpy(&timestamp, timestamps + i, sizeof(timestamp));
 
-        strings.push_back(str);
+          const double converted = static_cast<double>(timestamp);
+          std::memcpy(timestamps + i, &converted, sizeof(converted));
+        }
       }
-      break;
     }
-    default:
-      napi_throw_type_error(env, nullptr, "Unsupported data type in the array");
-      return nullptr;
-  }
 
-  napi_value promise;
-  napi_value asyncNameString;
-
-  napi_create_string_utf8(env, "encode", NAPI_AUTO_LENGTH, &asyncNameString);
+    if (valuesData) {
+      StageTimer valuesTimer(STAGE_VALUE_DECODE, header.itemCount, valuesSectionLength);
+      valuesTimer.setType(valueType);
+
+      if (valuesType == napi_float64_array) {
+        DecodeFloatsInto(valueType, valuesSection, valuesSectionLength, header.itemCount,
+                         static_cast<double*>(valuesData) + offset);
+      } else if (valuesType == napi_float32_array) {
+        DecodeFloats32Into(valueType, valuesSection, valuesSectionLength, header.itemCount,
+                           static_cast<float*>(valuesData) + offset);
+      } else {
+        DecodeBooleansInto(valueType, valuesSection, valuesSectionLength, header.itemCount,
+                           static_cast<uint8_t*>(valuesData) + offset);
+      }
+    }
+  } catch (const std::invalid_argument& e) {
+    napi_throw_type_error(env, nullptr, e.what());
+    return nullptr;
+  } catch (const std::exception& e) {
+    napi_throw_error(env, nullptr, e.what());
+    return nullptr;
+  }
 
-  napi_create_promise(env, &carrier->deferred, &promise);
-  napi_create_async_work(env, nullptr, asyncNameString, ExecuteCompression, CompressionComplete, carrier,
-                         &carrier->work);
-  napi_queue_async_work(env, carrier->work);
+  napi_value result;
+  napi_create_uint32(env, header.itemCount, &result);
 
-  return promise;
+  return result;
 }
 
-napi_value Decode(napi_env env, napi_callback_info info) {
+napi_value Inspect(napi_env env, napi_callback_info info) {
   size_t argc = 1;
   napi_value args[1];
   napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
@@ -616,32 +2142,532 @@ napi_value Decode(napi_env env, napi_callback_info info) {
     return nullptr;
   }
 
-  // Get buffer data
-  CompressionCarrier* carrier = new CompressionCarrier;
   size_t bufferLength;
   uint8_t* data = NULL;
 
   napi_get_buffer_info(env, args[0], (void**)&data, &bufferLength);
 
-  carrier->compressedData.resize(bufferLength);
-  std::copy(data, data + bufferLength, carrier->compressedData.begin());
+  if (bufferLength > 0 && data[0] == SNAPPY) {
+    napi_throw_error(env, nullptr, "Snappy compressed buffers must be decoded to be inspected");
+    return nullptr;
+  }
+
+  // Only the header is read, the encoded sections are left untouched
+  BufferHeader header;
+
+  if (!header.read(data, bufferLength)) {
+    napi_throw_error(env, nullptr, "Invalid data format");
+    return nullptr;
+  }
+
+  napi_value result, value;
+  napi_create_object(env, &result);
+
+  napi_create_uint32(env, header.itemCount, &value);
+  napi_set_named_property(env, result, "count", value);
+
+  napi_create_uint32(env, header.timestampType, &value);
+  napi_set_named_property(env, result, "timestampType", value);
+
+  napi_create_uint32(env, header.valueType, &value);
+  napi_set_named_property(env, result, "valueType", value);
+
+  napi_create_uint32(env, header.timestampsOffset, &value);
+  napi_set_named_property(env, result, "headerBytes", value);
+
+  napi_create_uint32(env, header.timestampsLength, &value);
+  napi_set_named_property(env, result, "timestampBytes", value);
+
+  napi_create_double(env, header.valuesLength + sizeof(uint8_t), &value);
+  napi_set_named_property(env, result, "valueBytes", value);
+
+  // Multi-column buffers also list each column's name, value type and size
+  if (header.valueType == MULTI_COLUMN_ENCODER) {
+    ColumnDirectory directory;
+
+    if (!directory.read(data + header.valuesOffset, header.valuesLength)) {
+      napi_throw_error(env, nullptr, "Invalid data format");
+      return nullptr;
+    }
+
+    napi_value columns;
+    napi_create_array_with_length(env, directory.columns.size(), &columns);
+
+    for (uint32_t i = 0; i < directory.columns.size(); i++) {
+      const auto& entry = directory.columns[i];
+
+      napi_value column;
+      napi_create_object(env, &column);
+
+      napi_create_string_utf8(env, entry.name.data(), entry.name.size(), &value);
+      napi_set_named_property(env, column, "name", value);
+
+      napi_create_uint32(env, entry.valueType, &value);
+      napi_set_named_property(env, column, "valueType", value);
+
+      napi_create_double(env, entry.valuesLength + sizeof(uint8_t), &value);
+      napi_set_named_property(env, column, "valueBytes", value);
+
+      napi_set_element(env, columns, i, column);
+    }
+
+    napi_set_named_property(env, result, "columns", columns);
+  }
+
+  if (header.hasTimeBounds && header.itemCount > 0) {
+    napi_create_double(env, header.minTimestamp, &value);
+    napi_set_named_property(env, result, "minTimestamp", value);
+
+    napi_create_double(env, header.maxTimestamp, &value);
+    napi_set_named_property(env, result, "maxTimestamp", value);
+  }
+
+  return result;
+}
+
+struct SegmentWriteCarrier {
+  napi_deferred deferred;
+  napi_async_work work;
+  std::string path;
+  std::vector<SegmentBlock> blocks;
+
+  // Keeps the JS buffers alive while their bytes are written from the thread pool
+  std::vector<napi_ref> buffers;
+  std::string error;
+};
+
+void ExecuteSegmentWrite(napi_env env, void* data) {
+  SegmentWriteCarrier* carrier = static_cast<SegmentWriteCarrier*>(data);
+
+  try {
+    SegmentWriter::write(carrier->path, carrier->blocks);
+  } catch (const std::exception& e) {
+    carrier->error = e.what();
+  }
+}
+
+void SegmentWriteComplete(napi_env env, napi_status status, void* data) {
+  SegmentWriteCarrier* carrier = static_cast<SegmentWriteCarrier*>(data);
+
+  for (napi_ref buffer : carrier->buffers) napi_delete_reference(env, buffer);
+
+  if (carrier->error.empty()) {
+    napi_value result;
+    napi_get_undefined(env, &result);
+    napi_resolve_deferred(env, carrier->deferred, result);
+  } else {
+    napi_value message, error;
+    napi_create_string_utf8(env, carrier->error.c_str(), NAPI_AUTO_LENGTH, &message);
+    napi_create_error(env, nullptr, message, &error);
+    napi_reject_deferred(env, carrier->deferred, error);
+  }
+
+  napi_delete_async_work(env, carrier->work);
+  delete carrier;
+}
+
+napi_value WriteSegment(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+  std::string path;
+  if (argc < 1 || !GetString(env, args[0], path)) {
+    napi_throw_type_error(env, nullptr, "First argument must be a path");
+    return nullptr;
+  }
+
+  bool isArray = false;
+  if (argc > 1) napi_is_array(env, args[1], &isArray);
+
+  if (!isArray) {
+    napi_throw_type_error(env, nullptr, "Second argument must be an array of { id, buffer } blocks");
+    return nullptr;
+  }
+
+  uint32_t blockCount;
+  napi_get_array_length(env, args[1], &blockCount);
+
+  SegmentWriteCarrier* carrier = new SegmentWriteCarrier;
+  carrier->path = path;
+  carrier->blocks.reserve(blockCount);
+
+  for (uint32_t i = 0; i < blockCount; i++) {
+    napi_value element, idValue, bufferValue;
+    napi_get_element(env, args[1], i, &element);
+
+    napi_valuetype elementType;
+    napi_typeof(env, element, &elementType);
+
+    SegmentBlock block;
+    bool isBuffer = false;
+
+    if (elementType == napi_object) {
+      napi_get_named_property(env, element, "id", &idValue);
+      napi_get_named_property(env, element, "buffer", &bufferValue);
+      napi_is_buffer(env, bufferValue, &isBuffer);
+    }
+
+    if (!isBuffer || !GetString(env, idValue, block.id)) {
+      for (napi_ref buffer : carrier->buffers) napi_delete_reference(env, buffer);
+      delete carrier;
+
+      napi_throw_type_error(env, nullptr, "Blocks must have a string id and a buffer");
+      return nullptr;
+    }
+
+    void* data;
+    napi_get_buffer_info(env, bufferValue, &data, &block.length);
+    block.data = static_cast<const uint8_t*>(data);
+
+    napi_ref reference;
+    napi_create_reference(env, bufferValue, 1, &reference);
+
+    carrier->buffers.push_back(reference);
+    carrier->blocks.push_back(std::move(block));
+  }
 
   napi_value promise;
   napi_value asyncNameString;
 
-  napi_create_string_utf8(env, "decode", NAPI_AUTO_LENGTH, &asyncNameString);
+  napi_create_string_utf8(env, "writeSegment", NAPI_AUTO_LENGTH, &asyncNameString);
 
   napi_create_promise(env, &carrier->deferred, &promise);
-  napi_create_async_work(env, nullptr, asyncNameString, ExecuteDecompression, DecompressionComplete, carrier,
+  napi_create_async_work(env, nullptr, asyncNameString, ExecuteSegmentWrite, SegmentWriteComplete, carrier,
                          &carrier->work);
   napi_queue_async_work(env, carrier->work);
 
   return promise;
 }
 
+// Wrapped by Segment objects, the mapping is released once closed and no
+// decode that still reads from it is in flight
+struct SegmentHandle {
+  std::shared_ptr<MappedSegment> segment;
+};
+
+napi_value SegmentConstructor(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1], thisValue;
+  napi_get_cb_info(env, info, &argc, args, &thisValue, nullptr);
+
+  std::string path;
+  if (argc < 1 || !GetString(env, args[0], path)) {
+    napi_throw_type_error(env, nullptr, "First argument must be a path");
+    return nullptr;
+  }
+
+  SegmentHandle* handle = new SegmentHandle;
+
+  try {
+    handle->segment = std::make_shared<MappedSegment>(path);
+  } catch (const std::exception& e) {
+    delete handle;
+    napi_throw_error(env, nullptr, e.what());
+    return nullptr;
+  }
+
+  napi_wrap(
+      env, thisValue, handle, [](napi_env env, void* data, void* hint) { delete static_cast<SegmentHandle*>(data); },
+      nullptr, nullptr);
+
+  return thisValue;
+}
+
+// Unwraps the segment a method was called on, throws if it has been closed
+std::shared_ptr<MappedSegment> UnwrapSegment(napi_env env, napi_value thisValue) {
+  SegmentHandle* handle = nullptr;
+  napi_unwrap(env, thisValue, reinterpret_cast<void**>(&handle));
+
+  if (!handle || !handle->segment) {
+    napi_throw_error(env, nullptr, "Segment is closed");
+    return nullptr;
+  }
+
+  return handle->segment;
+}
+
+napi_value SegmentSeries(napi_env env, napi_callback_info info) {
+  napi_value thisValue;
+  napi_get_cb_info(env, info, nullptr, nullptr, &thisValue, nullptr);
+
+  std::shared_ptr<MappedSegment> segment = UnwrapSegment(env, thisValue);
+  if (!segment) return nullptr;
+
+  // One entry per block, straight from the index
+  napi_value result, value;
+  napi_create_array_with_length(env, segment->entries.size(), &result);
+
+  for (uint32_t i = 0; i < segment->entries.size(); i++) {
+    const SegmentEntry& entry = segment->entries[i];
+
+    napi_value item;
+    napi_create_object(env, &item);
+
+    napi_create_string_utf8(env, entry.id.data(), entry.id.size(), &value);
+    napi_set_named_property(env, item, "id", value);
+
+    napi_create_uint32(env, entry.count, &value);
+    napi_set_named_property(env, item, "count", value);
+
+    napi_create_double(env, entry.length, &value);
+    napi_set_named_property(env, item, "bytes", value);
+
+    if (entry.count > 0 && entry.maxTimestamp != UINT64_MAX) {
+      napi_create_double(env, entry.minTimestamp, &value);
+      napi_set_named_property(env, item, "minTimestamp", value);
+
+      napi_create_double(env, entry.maxTimestamp, &value);
+      napi_set_named_property(env, item, "maxTimestamp", value);
+    }
+
+    napi_set_element(env, result, i, item);
+  }
+
+  return result;
+}
+
+napi_value SegmentDecode(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2], thisValue;
+  napi_get_cb_info(env, info, &argc, args, &thisValue, nullptr);
+
+  std::shared_ptr<MappedSegment> segment = UnwrapSegment(env, thisValue);
+  if (!segment) return nullptr;
+
+  std::string id;
+  if (argc < 1 || !GetString(env, args[0], id)) {
+    napi_throw_type_error(env, nullptr, "First argument must be a series id");
+    return nullptr;
+  }
+
+  const auto range = segment->find(id);
+
+  if (range.first == range.second) {
+    napi_throw_error(env, nullptr, "Unknown series");
+    return nullptr;
+  }
+
+  CompressionCarrier* carrier = new CompressionCarrier;
+  if (argc > 1) ReadDecodeOptions(env, args[1], carrier);
+
+  // Blocks are decoded in place from the mapped pages, skipping those outside the range
+  for (auto entry = range.first; entry != range.second; ++entry) {
+    if (carrier->hasRange && !entry->overlaps(carrier->from, carrier->to)) continue;
+
+    segment->prefetch(*entry);
+    carrier->blocks.emplace_back(segment->blockData(*entry), entry->length);
+  }
+
+  carrier->segment = segment;
+
+  return QueueDecompression(env, carrier);
+}
+
+napi_value SegmentClose(napi_env env, napi_callback_info info) {
+  napi_value thisValue;
+  napi_get_cb_info(env, info, nullptr, nullptr, &thisValue, nullptr);
+
+  SegmentHandle* handle = nullptr;
+  napi_unwrap(env, thisValue, reinterpret_cast<void**>(&handle));
+
+  if (handle) handle->segment.reset();
+
+  return nullptr;
+}
+
+napi_value OpenSegment(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+  napi_ref* constructorRef;
+  napi_get_instance_data(env, reinterpret_cast<void**>(&constructorRef));
+
+  napi_value constructor, result;
+  napi_get_reference_value(env, *constructorRef, &constructor);
+
+  if (napi_new_instance(env, constructor, argc, args, &result) != napi_ok) return nullptr;
+
+  return result;
+}
+
+napi_value CreateSegmentClass(napi_env env) {
+  napi_property_descriptor methods[] = {{"series", 0, SegmentSeries, 0, 0, 0, napi_default, 0},
+                                        {"decode", 0, SegmentDecode, 0, 0, 0, napi_default, 0},
+                                        {"close", 0, SegmentClose, 0, 0, 0, napi_default, 0}};
+
+  napi_value constructor;
+  napi_define_class(env, "Segment", NAPI_AUTO_LENGTH, SegmentConstructor, nullptr, sizeof(methods) / sizeof(methods[0]),
+                    methods, &constructor);
+
+  // openSegment() creates instances through the constructor kept here
+  napi_ref* constructorRef = new napi_ref;
+  napi_create_reference(env, constructor, 1, constructorRef);
+
+  napi_set_instance_data(
+      env, constructorRef,
+      [](napi_env env, void* data, void* hint) {
+        napi_ref* constructorRef = static_cast<napi_ref*>(data);
+        napi_delete_reference(env, *constructorRef);
+        delete constructorRef;
+      },
+      nullptr);
+
+  return constructor;
+}
+
+const std::pair<const char*, CompressionType> compressionTypes[] = {
+    {"INTEGER_ENCODER", INTEGER_ENCODER},
+    {"FLOAT_ENCODER", FLOAT_ENCODER},
+    {"BOOLEAN_ENCODER", BOOLEAN_ENCODER},
+    {"STRING_ENCODER", STRING_ENCODER},
+    {"STRING_DICTIONARY_ENCODER", STRING_DICTIONARY_ENCODER},
+    {"STRING_FRONT_CODED_ENCODER", STRING_FRONT_CODED_ENCODER},
+    {"BOOLEAN_HYBRID_ENCODER", BOOLEAN_HYBRID_ENCODER},
+    {"INTEGER_SCALED_ENCODER", INTEGER_SCALED_ENCODER},
+    {"FLOAT_RAW_ENCODER", FLOAT_RAW_ENCODER},
+    {"FLOAT_SNAPPY_ENCODER", FLOAT_SNAPPY_ENCODER},
+    {"SNAPPY", SNAPPY},
+    {"MULTI_COLUMN_ENCODER", MULTI_COLUMN_ENCODER},
+    {"NULLABLE_ENCODER", NULLABLE_ENCODER},
+    {"FLOAT_ENTROPY_ENCODER", FLOAT_ENTROPY_ENCODER},
+    {"FLOAT_FPC_ENCODER", FLOAT_FPC_ENCODER},
+    {"INTEGER_PFOR_ENCODER", INTEGER_PFOR_ENCODER},
+    {"FLOAT_SHUFFLE_ENCODER", FLOAT_SHUFFLE_ENCODER},
+    {"FLOAT32_ENCODER", FLOAT32_ENCODER},
+    {"FLOAT_RUNS_ENCODER", FLOAT_RUNS_ENCODER},
+    {"FLOAT_INTEGER_ENCODER", FLOAT_INTEGER_ENCODER}};
+
+napi_value CreateCompressionTypes(napi_env env) {
+  napi_value result;
+  napi_create_object(env, &result);
+
+  for (const auto& type : compressionTypes) {
+    napi_value value;
+    napi_create_uint32(env, type.second, &value);
+    napi_set_named_property(env, result, type.first, value);
+  }
+
+  napi_object_freeze(env, result);
+
+  return result;
+}
+
+napi_value CreateHistogram(napi_env env, const Histogram& histogram) {
+  napi_value result, value, buckets;
+  napi_create_object(env, &result);
+
+  napi_create_double(env, histogram.count.load(), &value);
+  napi_set_named_property(env, result, "count", value);
+
+  napi_create_double(env, histogram.totalNs.load(), &value);
+  napi_set_named_property(env, result, "totalNs", value);
+
+  napi_create_double(env, histogram.bytes.load(), &value);
+  napi_set_named_property(env, result, "bytes", value);
+
+  // Only the buckets that were hit, as { le: upper bound in ns, count }
+  napi_create_array(env, &buckets);
+  uint32_t index = 0;
+
+  for (int i = 0; i < Histogram::bucketCount; i++) {
+    const uint64_t count = histogram.buckets[i].load();
+    if (count == 0) continue;
+
+    napi_value bucket;
+    napi_create_object(env, &bucket);
+
+    napi_create_double(env, Histogram::bucketLimit(i), &value);
+    napi_set_named_property(env, bucket, "le", value);
+
+    napi_create_double(env, count, &value);
+    napi_set_named_property(env, bucket, "count", value);
+
+    napi_set_element(env, buckets, index++, bucket);
+  }
+
+  napi_set_named_property(env, result, "histogram", buckets);
+
+  return result;
+}
+
+napi_value GetStats(napi_env env, napi_callback_info info) {
+  napi_value result, value, stages, types;
+  napi_create_object(env, &result);
+
+  napi_get_boolean(env, Stats::compiled(), &value);
+  napi_set_named_property(env, result, "compiled", value);
+
+  napi_get_boolean(env, Stats::compiled() && Stats::enabled.load(), &value);
+  napi_set_named_property(env, result, "enabled", value);
+
+  napi_create_object(env, &stages);
+
+  for (int stage = 0; stage < STAGE_COUNT; stage++) {
+    napi_set_named_property(env, stages, Stats::stageName(static_cast<Stage>(stage)),
+                            CreateHistogram(env, Stats::stages[stage]));
+  }
+
+  napi_set_named_property(env, result, "stages", stages);
+
+  // Value encode and decode timings per CompressionType that was used
+  napi_create_object(env, &types);
+
+  for (const auto& type : compressionTypes) {
+    if (type.second >= Stats::typeCount) continue;
+
+    const Histogram& encode = Stats::encodeTypes[type.second];
+    const Histogram& decode = Stats::decodeTypes[type.second];
+
+    if (encode.count.load() == 0 && decode.count.load() == 0) continue;
+
+    napi_value entry;
+    napi_create_object(env, &entry);
+    napi_set_named_property(env, entry, "encode", CreateHistogram(env, encode));
+    napi_set_named_property(env, entry, "decode", CreateHistogram(env, decode));
+    napi_set_named_property(env, types, type.first, entry);
+  }
+
+  napi_set_named_property(env, result, "types", types);
+
+  return result;
+}
+
+napi_value ResetStats(napi_env env, napi_callback_info info) {
+  Stats::reset();
+  return nullptr;
+}
+
+napi_value SetStatsEnabled(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+  bool enabled;
+  if (argc < 1 || napi_get_value_bool(env, args[0], &enabled) != napi_ok) {
+    napi_throw_type_error(env, nullptr, "First argument must be a boolean");
+    return nullptr;
+  }
+
+  Stats::enabled = enabled;
+  return nullptr;
+}
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
   napi_property_descriptor desc[] = {{"encode", 0, Encode, 0, 0, 0, napi_default, 0},
-                                     {"decode", 0, Decode, 0, 0, 0, napi_default, 0}};
+                                     {"encodeInto", 0, EncodeInto, 0, 0, 0, napi_default, 0},
+                                     {"encodeBound", 0, EncodeBound, 0, 0, 0, napi_default, 0},
+                                     {"decode", 0, Decode, 0, 0, 0, napi_default, 0},
+                                     {"decodeInto", 0, DecodeInto, 0, 0, 0, napi_default, 0},
+                                     {"inspect", 0, Inspect, 0, 0, 0, napi_default, 0},
+                                     {"writeSegment", 0, WriteSegment, 0, 0, 0, napi_default, 0},
+                                     {"openSegment", 0, OpenSegment, 0, 0, 0, napi_default, 0},
+                                     {"getStats", 0, GetStats, 0, 0, 0, napi_default, 0},
+                                     {"resetStats", 0, ResetStats, 0, 0, 0, napi_default, 0},
+                                     {"setStatsEnabled", 0, SetStatsEnabled, 0, 0, 0, napi_default, 0},
+                                     {"Segment", 0, 0, 0, 0, CreateSegmentClass(env), napi_default, 0},
+                                     {"CompressionType", 0, 0, 0, 0, CreateCompressionTypes(env), napi_enumerable, 0}};
   napi_define_properties(env, exports, sizeof(desc) / sizeof(desc[0]), desc);
   return exports;
 }
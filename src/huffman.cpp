@@ -0,0 +1,111 @@
+#include "huffman.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+std::vector<uint8_t> HuffmanCode::lengths(const std::vector<uint64_t>& counts) {
+  std::vector<uint8_t> out(counts.size(), 0);
+  std::vector<uint64_t> weights(counts);
+
+  size_t used = 0;
+  for (uint64_t weight : weights) used += weight > 0;
+
+  if (used == 0) return out;
+
+  // A lone symbol still takes a bit so every symbol moves the stream forward
+  if (used == 1) {
+    for (size_t i = 0; i < weights.size(); i++) out[i] = weights[i] > 0;
+    return out;
+  }
+
+  while (true) {
+    // Leaves are the symbols, internal nodes are appended after them
+    using Node = std::pair<uint64_t, size_t>;
+    std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+    std::vector<size_t> parent(weights.size(), 0);
+
+    for (size_t i = 0; i < weights.size(); i++) {
+      if (weights[i] > 0) queue.push({weights[i], i});
+    }
+
+    while (queue.size() > 1) {
+      const Node a = queue.top();
+      queue.pop();
+      const Node b = queue.top();
+      queue.pop();
+
+      const size_t node = parent.size();
+      parent.push_back(0);
+      parent[a.second] = node;
+      parent[b.second] = node;
+
+      queue.push({a.first + b.first, node});
+    }
+
+    const size_t root = queue.top().second;
+    int longest = 0;
+
+    for (size_t i = 0; i < weights.size(); i++) {
+      if (weights[i] == 0) continue;
+
+      int depth = 0;
+      for (size_t node = i; node != root; node = parent[node]) depth++;
+
+      out[i] = std::min(depth, 255);
+      longest = std::max(longest, depth);
+    }
+
+    if (longest <= maxLength) return out;
+
+    // Halving the counts (keeping them above 0) makes the distribution flatter and the tree shallower
+    for (uint64_t& weight : weights) {
+      if (weight > 0) weight = (weight >> 1) | 1;
+    }
+  }
+}
+
+HuffmanCode::HuffmanCode(const std::vector<uint8_t>& lengths)
+    : codes(lengths.size(), 0), codeLengths(lengths), table(1u << maxLength) {
+  uint32_t lengthCounts[maxLength + 1] = {};
+
+  for (uint8_t length : lengths) {
+    if (length > maxLength) throw std::runtime_error("Invalid data format");
+    if (length > 0) lengthCounts[length]++;
+  }
+
+  // Kraft's inequality, longer codes would not fit next to the shorter ones
+  uint64_t space = 0;
+  for (int length = 1; length <= maxLength; length++) space += uint64_t(lengthCounts[length]) << (maxLength - length);
+
+  if (space > (1u << maxLength)) throw std::runtime_error("Invalid data format");
+
+  // Codes of each length follow the last code of the length before, in symbol order
+  uint32_t nextCode[maxLength + 1] = {};
+  uint32_t code = 0;
+
+  for (int length = 1; length <= maxLength; length++) {
+    code = (code + lengthCounts[length - 1]) << 1;
+    nextCode[length] = code;
+  }
+
+  for (size_t symbol = 0; symbol < lengths.size(); symbol++) {
+    const int length = lengths[symbol];
+    if (length == 0) continue;
+
+    // Reversed so the first bit of the code is the first bit read
+    const uint32_t canonical = nextCode[length]++;
+    uint32_t reversed = 0;
+
+    for (int bit = 0; bit < length; bit++) reversed |= ((canonical >> bit) & 1) << (length - 1 - bit);
+
+    codes[symbol] = reversed;
+
+    for (uint32_t index = reversed; index < table.size(); index += 1u << length) {
+      table[index].symbol = symbol;
+      table[index].length = length;
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef __HUFFMAN_H_INCLUDED__
+#define __HUFFMAN_H_INCLUDED__
+
+#include <cstdint>
+#include <vector>
+
+#include "bit_reader.hpp"
+#include "compressed_buffer.hpp"
+
+// Canonical Huffman code over a small alphabet. Codes are written least
+// significant bit first like the rest of the bit streams, so a symbol is
+// decoded with one table lookup on the next maxLength bits
+class HuffmanCode {
+ public:
+  // Longest code, which sets the decode table to 2^maxLength entries
+  static constexpr int maxLength = 12;
+
+  struct Entry {
+    uint16_t symbol = 0;
+    uint8_t length = 0;
+  };
+
+  // Code lengths for the symbol counts, 0 for symbols that never occur.
+  // Counts are flattened until no code is longer than maxLength
+  static std::vector<uint8_t> lengths(const std::vector<uint64_t>& counts);
+
+  // Builds the codes from their lengths, throws std::runtime_error if they do not form a prefix code
+  explicit HuffmanCode(const std::vector<uint8_t>& lengths);
+
+  void write(CompressedBuffer& out, size_t symbol) const { out.write(codes[symbol], codeLengths[symbol]); }
+
+  uint32_t code(size_t symbol) const { return codes[symbol]; }
+  int length(size_t symbol) const { return codeLengths[symbol]; }
+
+  // The code at the low bits of a window of the stream, for callers that keep the window themselves
+  const Entry& lookup(uint64_t bits) const { return table[bits & ((1u << maxLength) - 1)]; }
+
+  template <bool checked = true>
+  uint16_t read(BitReader& in) const {
+    const Entry& entry = table[in.peek<checked>() & ((1u << maxLength) - 1)];
+    in.skip(entry.length);
+
+    return entry.symbol;
+  }
+
+ private:
+  std::vector<uint32_t> codes;
+  std::vector<uint8_t> codeLengths;
+  std::vector<Entry> table;
+};
+
+#endif
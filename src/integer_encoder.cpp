@@ -1,75 +1,617 @@
 #include "integer_encoder.hpp"
 #include "simple8b.hpp"
 #include "slice_buffer.hpp"
+#include "util.hpp"
 #include "zigzag.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <iostream>
 #include <limits>
+#include <numeric>
+#include <utility>
 
-// Timestamp encoding - http://www.vldb.org/pvldb/vol8/p1816-teller.pdf
+// Hybrid layout:
+//   [uint64 divisor][uint64 start value][uint64 zigzag first delta]
+//   [uint64 block header][block words]... one block per pforBlockSize zigzag deltas of deltas
+//
+// Block header:
+//   bits 0-7 bit width, or simple8bBlock for Simple8B words
+//   bits 8-15 exception count, bits 16-47 block word count
+//
+// PFOR block:
+//   [2 * width words] the low width bits of 128 values, 64 values per width words
+//   [exception positions] one byte each, 8 per word
+//   [exception words] the bits of each exception above the width
+
+namespace {
+
+// Running state of the delta of delta reconstruction, values are written as
+// base + last * scale so scaled series need no second pass
+struct DeltaState {
+  uint64_t last;
+  int64_t delta;
+  uint64_t base;
+  uint64_t scale;
+
+  uint64_t output(uint64_t value) const { return base + value * scale; }
+
+  // Corrupt deltas wrap around instead of overflowing the signed delta
+  void apply(uint64_t encoded, uint64_t &out) {
+    delta = static_cast<int64_t>(static_cast<uint64_t>(delta) +
+                                 static_cast<uint64_t>(ZigZag::zigzagDecode(encoded)));
+    last += delta;
+    out = output(last);
+  }
+};
+
+// Rebuilds at most limit values from the n packed deltas of deltas of a word
+template <uint64_t n, uint64_t bits>
+inline size_t decodeWord(uint64_t word, uint64_t *out, size_t limit,
+                         DeltaState &state) {
+  constexpr uint64_t mask = (1ull << bits) - 1;
+  const size_t count = std::min<size_t>(n, limit);
+
+  // Regular intervals pack into words of zeros, where the delta stays the
+  // same and the values no longer depend on each other
+  if ((word & ((1ull << 60) - 1)) == 0) {
+    const uint64_t delta = state.delta;
+
+    for (size_t i = 0; i < count; i++) {
+      out[i] = state.output(state.last + delta * (i + 1));
+    }
+
+    state.last += delta * count;
+    return count;
+  }
+
+  if (count == n) {
+    loop<int, n>([&](auto i) {
+      constexpr int shiftAmount = i * bits;
+      state.apply((word >> shiftAmount) & mask, out[i]);
+    });
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      state.apply((word >> (i * bits)) & mask, out[i]);
+    }
+  }
+
+  return count;
+}
+
+constexpr uint64_t simple8bBlock = 0xff;
+
+// Unpacks the 64 values of width bits held by width words
+template <int width>
+void unpackGroup(const uint8_t *in, uint64_t *out) {
+  if constexpr (width == 0) {
+    std::fill(out, out + 64, 0);
+  } else {
+    uint64_t words[width];
+    std::memcpy(words, in, sizeof(words));
+
+    constexpr uint64_t mask = width == 64 ? ~0ull : (1ull << width) - 1;
+
+    loop<int, 64>([&](auto i) {
+      constexpr int bit = i * width;
+      constexpr int shift = bit % 64;
+
+      uint64_t value = words[bit / 64] >> shift;
+      if constexpr (shift + width > 64) value |= words[bit / 64 + 1] << (64 - shift);
 
-AlignedBuffer IntegerEncoder::encode(const std::vector<uint64_t> &values) {
+      out[i] = value & mask;
+    });
+  }
+}
+
+template <int width>
+void unpackBlock(const uint8_t *in, uint64_t *out) {
+  unpackGroup<width>(in, out);
+  unpackGroup<width>(in + width * sizeof(uint64_t), out + 64);
+}
+
+template <size_t... widths>
+constexpr auto makeUnpackers(std::index_sequence<widths...>) {
+  return std::array<void (*)(const uint8_t *, uint64_t *), sizeof...(widths)>{
+      unpackBlock<widths>...};
+}
+
+// Unpacks a block with straight line shifts, one instance per bit width
+constexpr auto unpackers = makeUnpackers(std::make_index_sequence<65>{});
+
+// Number of significant bits
+int bitWidth(uint64_t value) {
+  return value == 0 ? 0 : 64 - getLeadingZeroBitsUnsafe(value);
+}
+
+// Words taken by a PFOR block packed at width with exceptions wider values
+size_t pforWords(int width, size_t exceptions) {
+  return 2 * width + (exceptions + 7) / 8 + exceptions;
+}
+
+// Appends the zigzag encoded deltas of deltas of values[1..], each delta
+// divided by scale. Unscaled series skip the division entirely
+template <bool scaled>
+void appendDeltasOfDeltas(const std::vector<uint64_t> &values, int64_t scale,
+                          std::vector<uint64_t> &encoded) {
+  // Repeated deltas reuse the last quotient
+  int64_t lastDelta = 0, lastQuotient = 0;
+
+  const auto deltaAt = [&](size_t i) {
+    const int64_t delta = static_cast<int64_t>(values[i] - values[i - 1]);
+    if (!scaled)
+      return delta;
+
+    if (delta != lastDelta) {
+      lastDelta = delta;
+      lastQuotient = delta / scale;
+    }
+
+    return lastQuotient;
+  };
+
+  int64_t delta = deltaAt(1);
+  encoded.push_back(ZigZag::zigzagEncode(delta));
+
+  for (size_t i = 2; i < values.size(); i++) {
+    const int64_t next_delta = deltaAt(i);
+
+    // Wraps around like the decoder for deltas that far apart
+    encoded.push_back(ZigZag::zigzagEncode(static_cast<int64_t>(
+        static_cast<uint64_t>(next_delta) - static_cast<uint64_t>(delta))));
+
+    delta = next_delta;
+  }
+}
+
+// The zigzag encoded start value, first delta and deltas of deltas
+std::vector<uint64_t> deltasOfDeltas(const std::vector<uint64_t> &values,
+                                     uint64_t divisor) {
   std::vector<uint64_t> encoded;
   encoded.reserve(values.size());
 
   if (values.size() == 0)
-    return Simple8B::encode(encoded);
+    return encoded;
 
-  uint64_t start_value = values[0];
-  encoded.push_back(start_value);
+  encoded.push_back(values[0]);
 
   if (values.size() == 1)
-    return Simple8B::encode(encoded);
+    return encoded;
+
+  if (divisor == 1) {
+    appendDeltasOfDeltas<false>(values, 1, encoded);
+  } else {
+    appendDeltasOfDeltas<true>(values, static_cast<int64_t>(divisor), encoded);
+  }
+
+  return encoded;
+}
+
+// Marks a block that Simple8B cannot pack, its values being wider than 60 bits
+constexpr size_t unpackable = SIZE_MAX;
+
+// Appends one block of at most pforBlockSize deltas of deltas, and returns
+// the words Simple8B packs it in, or unpackable
+size_t encodeBlock(std::vector<uint64_t> &block, AlignedBuffer &out) {
+  size_t widths[65] = {};
+  for (uint64_t value : block)
+    widths[bitWidth(value)]++;
+
+  // The narrowest packing wins, wider values becoming exceptions
+  int width = 64;
+  size_t exceptions = 0;
+  size_t words = pforWords(64, 0);
+  size_t wider = 0;
+
+  for (int candidate = 64; candidate >= 0; candidate--) {
+    if (pforWords(candidate, wider) <= words) {
+      width = candidate;
+      exceptions = wider;
+      words = pforWords(candidate, wider);
+    }
+
+    wider += widths[candidate];
+  }
+
+  // Simple8B cannot hold values of more than 60 bits
+  size_t maxWidth = 64;
+  while (maxWidth > 0 && widths[maxWidth] == 0)
+    maxWidth--;
+
+  size_t packedWords = unpackable;
 
-  int64_t delta = values[1] - values[0];
-  uint64_t first_delta = ZigZag::zigzagEncode(delta);
+  if (maxWidth <= 60) {
+    AlignedBuffer packed = Simple8B::encode(block);
+    packedWords = packed.size() / sizeof(uint64_t);
+
+    if (packedWords < words) {
+      out.write<uint64_t>(simple8bBlock | packedWords << 16);
+      out.write(packed);
+      return packedWords;
+    }
+  }
 
-  encoded.push_back(first_delta);
+  out.write<uint64_t>(width | exceptions << 8 | words << 16);
 
-  if (values.size() == 2)
-    return Simple8B::encode(encoded);
+  std::vector<uint64_t> packed(2 * width, 0);
+  std::vector<uint8_t> positions((exceptions + 7) / 8 * sizeof(uint64_t), 0);
+  std::vector<uint64_t> highs;
 
-  for (unsigned int i = 2; i < values.size(); i++) {
-    int64_t D = (values[i] - values[i - 1]) - (values[i - 1] - values[i - 2]);
-    uint64_t encD = ZigZag::zigzagEncode(D);
-    encoded.push_back(encD);
+  const uint64_t mask = width == 64 ? ~0ull : (1ull << width) - 1;
+
+  for (size_t i = 0; i < block.size(); i++) {
+    const uint64_t low = block[i] & mask;
+    const size_t bit = i * width;
+
+    if (width > 0) {
+      packed[bit / 64] |= low << (bit % 64);
+      if (bit % 64 + width > 64)
+        packed[bit / 64 + 1] |= low >> (64 - bit % 64);
+    }
+
+    if (bitWidth(block[i]) > width) {
+      positions[highs.size()] = i;
+      highs.push_back(block[i] >> width);
+    }
   }
 
+  for (uint64_t word : packed)
+    out.write(word);
+
+  out.data.insert(out.data.end(), positions.begin(), positions.end());
+
+  for (uint64_t high : highs)
+    out.write(high);
+
+  return packedWords;
+}
+
+// Writes the hybrid layout of the deltas of deltas, and returns the words a
+// plain Simple8B stream of them takes when made of the same blocks, or
+// unpackable
+size_t encodeHybridBlocks(const std::vector<uint64_t> &encoded,
+                          uint64_t divisor, AlignedBuffer &out) {
+  out.write(divisor);
+  out.write<uint64_t>(encoded.size() > 0 ? encoded[0] : 0);
+  out.write<uint64_t>(encoded.size() > 1 ? encoded[1] : 0);
+
+  // The start value and first delta share the first words of a plain stream
+  std::vector<uint64_t> block(encoded.begin(),
+                              encoded.begin() + std::min<size_t>(encoded.size(), 2));
+  size_t plainWords = 0;
+
+  for (uint64_t value : block) {
+    if (bitWidth(value) > 60)
+      plainWords = unpackable;
+  }
+
+  if (plainWords == 0)
+    plainWords = Simple8B::encode(block).size() / sizeof(uint64_t);
+
+  const size_t blockSize = IntegerEncoder::pforBlockSize;
+  block.reserve(blockSize);
+
+  for (size_t i = 2; i < encoded.size(); i += blockSize) {
+    block.assign(encoded.begin() + i,
+                 encoded.begin() + std::min(i + blockSize, encoded.size()));
+
+    const size_t packedWords = encodeBlock(block, out);
+    plainWords = packedWords == unpackable || plainWords == unpackable
+                     ? unpackable
+                     : plainWords + packedWords;
+  }
+
+  return plainWords;
+}
+
+template <class T> T load(const uint8_t *data) {
+  T value;
+  std::memcpy(&value, data, sizeof(T));
+  return value;
+}
+
+} // namespace
+
+// Every Simple8B word holds at least one value, and scaled series add the divisor
+size_t IntegerEncoder::maxEncodedSize(size_t size) {
+  return sizeof(uint64_t) + size * sizeof(uint64_t);
+}
+
+// Timestamp encoding - http://www.vldb.org/pvldb/vol8/p1816-teller.pdf
+//
+// With a divisor the first value is stored as is and every following value
+// as its distance from the first divided by the divisor.
+
+AlignedBuffer IntegerEncoder::encode(const std::vector<uint64_t> &values,
+                                     uint64_t divisor) {
+  std::vector<uint64_t> encoded = deltasOfDeltas(values, divisor);
   return Simple8B::encode(encoded);
 }
 
-void IntegerEncoder::decode(Slice &encoded, std::vector<uint64_t> &values,
-                            size_t size) {
+AlignedBuffer IntegerEncoder::encodeHybrid(const std::vector<uint64_t> &values,
+                                           uint64_t divisor) {
+  const std::vector<uint64_t> encoded = deltasOfDeltas(values, divisor);
+
+  AlignedBuffer out;
+  encodeHybridBlocks(encoded, divisor, out);
+
+  return out;
+}
+
+bool IntegerEncoder::encodeSmallest(const std::vector<uint64_t> &values,
+                                    uint64_t divisor, AlignedBuffer &out) {
+  std::vector<uint64_t> encoded = deltasOfDeltas(values, divisor);
+
+  AlignedBuffer hybrid;
+  const size_t plainWords = encodeHybridBlocks(encoded, divisor, hybrid);
+
+  const size_t divisorSize = divisor > 1 ? sizeof(uint64_t) : 0;
+
+  if (plainWords == unpackable ||
+      plainWords * sizeof(uint64_t) + divisorSize >= hybrid.size()) {
+    out.data.swap(hybrid.data);
+    return true;
+  }
+
+  // Simple8B words never pad, so the words of the start value, first delta
+  // and of every block, packed on their own, still form one plain stream
+  std::vector<uint64_t> block(encoded.begin(),
+                              encoded.begin() + std::min<size_t>(encoded.size(), 2));
+  AlignedBuffer packed = Simple8B::encode(block);
+  out.write(packed);
+
+  size_t offset = 3 * sizeof(uint64_t);
+
+  for (size_t i = 2; i < encoded.size(); i += pforBlockSize) {
+    const uint64_t header = load<uint64_t>(hybrid.data.data() + offset);
+    const size_t words = (header >> 16) & 0xffffffff;
+    offset += sizeof(uint64_t);
+
+    if ((header & 0xff) == simple8bBlock) {
+      out.data.insert(out.data.end(), hybrid.data.begin() + offset,
+                      hybrid.data.begin() + offset + words * sizeof(uint64_t));
+    } else {
+      // PFOR blocks that were smaller are packed again
+      block.assign(encoded.begin() + i,
+                   encoded.begin() + std::min(i + pforBlockSize, encoded.size()));
+      packed = Simple8B::encode(block);
+      out.write(packed);
+    }
+
+    offset += words * sizeof(uint64_t);
+  }
+
+  return false;
+}
+
+void IntegerEncoder::decodeHybrid(Slice &encoded, std::vector<uint64_t> &values,
+                                  size_t size) {
+  const size_t begin = values.size();
+
+  values.resize(begin + size);
+  values.resize(begin + decodeHybrid(encoded, values.data() + begin, size));
+}
+
+size_t IntegerEncoder::decodeHybrid(Slice &encoded, uint64_t *out,
+                                    size_t size) {
   if (size == 0)
-    return;
+    return 0;
+
+  const uint64_t divisor = encoded.read<uint64_t>();
+  const uint64_t start_value = encoded.read<uint64_t>();
+  const uint64_t first_delta = encoded.read<uint64_t>();
 
-  std::vector<uint64_t> deltaValues = Simple8B::decode(encoded);
+  DeltaState state = divisor == 1 ? DeltaState{start_value, 0, 0, 1}
+                                  : DeltaState{0, 0, start_value, divisor};
+
+  size_t count = 0;
+  out[count++] = start_value;
+
+  if (count < size) {
+    state.delta = ZigZag::zigzagDecode(first_delta);
+    state.last += state.delta;
+    out[count++] = state.output(state.last);
+  }
 
-  uint64_t last_decoded = deltaValues[0];
+  uint64_t block[pforBlockSize];
 
-  values.push_back(last_decoded);
+  while (count < size) {
+    const uint64_t header = encoded.read<uint64_t>();
+    const uint64_t width = header & 0xff;
+    const size_t exceptions = (header >> 8) & 0xff;
+    const size_t words = (header >> 16) & 0xffffffff;
 
-  if (size == 1)
-    return;
+    const uint8_t *payload = encoded.data + encoded.offset;
+    encoded.offset += words * sizeof(uint64_t);
+
+    if (width == simple8bBlock) {
+      const size_t blockEnd = std::min(size, count + pforBlockSize);
+
+      for (size_t word = 0; word < words && count < blockEnd; word++) {
+        const uint64_t packed = load<uint64_t>(payload + word * sizeof(uint64_t));
+
+        count += Simple8B::visit(packed, [&](auto n, auto bits) {
+          return decodeWord<decltype(n)::value, decltype(bits)::value>(
+              packed, out + count, blockEnd - count, state);
+        });
+      }
+
+      continue;
+    }
 
-  int64_t delta = ZigZag::zigzagDecode(deltaValues[1]);
-  last_decoded += delta;
+    const size_t blockCount = std::min(size - count, pforBlockSize);
 
-  values.push_back(last_decoded);
+    // Like words of zeros, blocks of zeros keep the same delta throughout
+    if (width == 0 && exceptions == 0) {
+      const uint64_t delta = state.delta;
 
-  if (size == 2)
-    return;
+      for (size_t i = 0; i < blockCount; i++)
+        out[count + i] = state.output(state.last + delta * (i + 1));
 
-  for (unsigned int i = 2; i < deltaValues.size(); i++) {
-    int64_t encD = ZigZag::zigzagDecode(deltaValues[i]);
+      state.last += delta * blockCount;
+      count += blockCount;
+      continue;
+    }
 
-    delta += encD;
-    last_decoded += delta;
+    unpackers[width](payload, block);
 
-    values.push_back(last_decoded);
+    // Exceptions put back the bits above the width
+    const uint8_t *positions = payload + 2 * width * sizeof(uint64_t);
+    const uint8_t *highs =
+        positions + (exceptions + 7) / 8 * sizeof(uint64_t);
 
-    if (values.size() == size) {
-      break;
+    for (size_t i = 0; i < exceptions; i++) {
+      block[positions[i] % pforBlockSize] |=
+          load<uint64_t>(highs + i * sizeof(uint64_t)) << width;
     }
+
+    for (size_t i = 0; i < blockCount; i++)
+      state.apply(block[i], out[count + i]);
+
+    count += blockCount;
   }
+
+  return count;
+}
+
+void IntegerEncoder::decode(Slice &encoded, std::vector<uint64_t> &values,
+                            size_t size, uint64_t divisor) {
+  const size_t begin = values.size();
+
+  values.resize(begin + size);
+  values.resize(begin + decode(encoded, values.data() + begin, size, divisor));
+}
+
+size_t IntegerEncoder::decode(Slice &encoded, uint64_t *out, size_t size,
+                              uint64_t divisor) {
+  const size_t words = encoded.length<uint64_t>();
+
+  if (size == 0 || words == 0)
+    return 0;
+
+  // The leading words hold the start value and the first delta, which are
+  // unpacked as they are before the fused loop takes over
+  uint64_t unpacked[Simple8B::maxPerWord];
+  size_t unpackedCount = Simple8B::unpack(encoded.read<uint64_t>(), unpacked);
+  size_t word = 1;
+  size_t next = 0;
+  size_t count = 0;
+
+  const uint64_t start_value = unpacked[next++];
+
+  // Scaled series are rebuilt as offsets from the first value
+  DeltaState state = divisor == 1 ? DeltaState{start_value, 0, 0, 1}
+                                  : DeltaState{0, 0, start_value, divisor};
+
+  out[count++] = start_value;
+
+  if (next == unpackedCount && word < words) {
+    unpackedCount = Simple8B::unpack(encoded.read<uint64_t>(), unpacked);
+    next = 0;
+    word++;
+  }
+
+  if (count < size && next < unpackedCount) {
+    state.delta = ZigZag::zigzagDecode(unpacked[next++]);
+    state.last += state.delta;
+
+    out[count++] = state.output(state.last);
+
+    for (; next < unpackedCount && count < size; next++) {
+      state.apply(unpacked[next], out[count++]);
+    }
+  }
+
+  // Every following word goes straight from packed deltas of deltas to values
+  for (; word < words && count < size; word++) {
+    const uint64_t packed = encoded.read<uint64_t>();
+
+    count += Simple8B::visit(packed, [&](auto n, auto bits) {
+      return decodeWord<decltype(n)::value, decltype(bits)::value>(
+          packed, out + count, size - count, state);
+    });
+  }
+
+  return count;
+}
+
+bool IntegerEncoder::validate(const uint8_t *data, size_t length,
+                              size_t size) {
+  return Simple8B::count(data, length) >= size;
+}
+
+bool IntegerEncoder::validateHybrid(const uint8_t *data, size_t length,
+                                    size_t size) {
+  if (size == 0)
+    return true;
+
+  // The divisor, start value and first delta
+  if (length < 3 * sizeof(uint64_t))
+    return false;
+
+  size_t offset = 3 * sizeof(uint64_t);
+  size_t count = std::min<size_t>(size, 2);
+
+  while (count < size) {
+    if (length - offset < sizeof(uint64_t))
+      return false;
+
+    const uint64_t header = load<uint64_t>(data + offset);
+    offset += sizeof(uint64_t);
+
+    const uint64_t width = header & 0xff;
+    const size_t exceptions = (header >> 8) & 0xff;
+    const size_t words = (header >> 16) & 0xffffffff;
+
+    if ((length - offset) / sizeof(uint64_t) < words)
+      return false;
+
+    if (width == simple8bBlock) {
+      const size_t packed = Simple8B::count(data + offset, words * sizeof(uint64_t));
+      count += std::min({packed, pforBlockSize, size - count});
+    } else {
+      if (width > 64 || exceptions > pforBlockSize ||
+          (width == 64 && exceptions > 0) ||
+          words != pforWords(width, exceptions))
+        return false;
+
+      count += std::min(pforBlockSize, size - count);
+    }
+
+    offset += words * sizeof(uint64_t);
+  }
+
+  return true;
+}
+
+uint64_t IntegerEncoder::commonDivisor(const std::vector<uint64_t> &values) {
+  uint64_t divisor = 0;
+  uint64_t previous = 0;
+
+  // The distances from the first value share the divisor of the steps
+  // between neighbours, which mostly repeat and are only checked once
+  for (size_t i = 1; i < values.size(); i++) {
+    uint64_t step = values[i] - values[i - 1];
+
+    if (step == previous)
+      continue;
+
+    previous = step;
+
+    if (static_cast<int64_t>(step) < 0)
+      step = -step;
+
+    // Most steps are multiples of the divisor found so far, only the others
+    // need a gcd
+    if (divisor != 0 && step % divisor == 0)
+      continue;
+
+    divisor = std::gcd(divisor, step);
+
+    if (divisor == 1)
+      return 1;
+  }
+
+  return divisor == 0 ? 1 : divisor;
 }
@@ -12,9 +12,45 @@ private:
 public:
   IntegerEncoder();
 
-  static AlignedBuffer encode(const std::vector<uint64_t> &values);
+  static AlignedBuffer encode(const std::vector<uint64_t> &values,
+                              uint64_t divisor = 1);
   static void decode(Slice &encoded, std::vector<uint64_t> &values,
-                     size_t size);
+                     size_t size, uint64_t divisor = 1);
+
+  // Decodes up to size values into out, returns how many were written
+  static size_t decode(Slice &encoded, uint64_t *out, size_t size,
+                       uint64_t divisor = 1);
+
+  // Patched frame of reference: the deltas of deltas are split into blocks
+  // of pforBlockSize, each bit packed at the width most of them fit in with
+  // the few wider ones kept as exceptions, or packed with Simple8B where that
+  // is smaller. The divisor is stored with the values
+  static constexpr size_t pforBlockSize = 128;
+
+  static AlignedBuffer encodeHybrid(const std::vector<uint64_t> &values,
+                                    uint64_t divisor = 1);
+  static void decodeHybrid(Slice &encoded, std::vector<uint64_t> &values,
+                           size_t size);
+  static size_t decodeHybrid(Slice &encoded, uint64_t *out, size_t size);
+
+  // Encodes values in the hybrid layout, or in the plain layout of encode when
+  // that is smaller counting the divisor stored ahead of a scaled stream.
+  // The deltas are computed once and the plain stream is made of the blocks'
+  // Simple8B words. Returns true when out holds the hybrid layout
+  static bool encodeSmallest(const std::vector<uint64_t> &values,
+                             uint64_t divisor, AlignedBuffer &out);
+
+  // Check a section from its lengths and selectors alone, false if it is
+  // malformed or holds fewer than size values. The decoders trust sections
+  // that passed and skip these checks
+  static bool validate(const uint8_t *data, size_t length, size_t size);
+  static bool validateHybrid(const uint8_t *data, size_t length, size_t size);
+
+  // Upper bound of the encoded size of size values, divisor included
+  static size_t maxEncodedSize(size_t size);
+
+  // Largest divisor shared by the distance of every value from the first
+  static uint64_t commonDivisor(const std::vector<uint64_t> &values);
 };
 
 #endif
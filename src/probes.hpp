@@ -0,0 +1,22 @@
+#ifndef __PROBES_H_INCLUDED__
+#define __PROBES_H_INCLUDED__
+
+// USDT probes for perf/bpftrace, compiled in when GORILLA_USDT is set and sys/sdt.h is available.
+// Probes live under the `gorilla_codec` provider and cost a single nop when nothing is attached.
+
+#if defined(GORILLA_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define GORILLA_HAS_USDT 1
+#endif
+#endif
+
+#ifdef GORILLA_HAS_USDT
+#define GORILLA_PROBE_START(name, points, bytes) DTRACE_PROBE2(gorilla_codec, name##__start, points, bytes)
+#define GORILLA_PROBE_DONE(name, points, bytes, type) DTRACE_PROBE3(gorilla_codec, name##__done, points, bytes, type)
+#else
+#define GORILLA_PROBE_START(name, points, bytes)
+#define GORILLA_PROBE_DONE(name, points, bytes, type)
+#endif
+
+#endif
@@ -0,0 +1,264 @@
+#include "segment.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "buffer_header.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+template <class T>
+void append(std::vector<uint8_t>& out, T value) {
+  const size_t offset = out.size();
+  out.resize(offset + sizeof(T));
+  std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+template <class T>
+T load(const uint8_t* data, size_t length, size_t& offset) {
+  if (length - offset < sizeof(T)) throw std::runtime_error("Invalid segment index");
+
+  T value;
+  std::memcpy(&value, data + offset, sizeof(T));
+  offset += sizeof(T);
+
+  return value;
+}
+
+void writeAll(FILE* file, const void* data, size_t length, const std::string& path) {
+  if (length > 0 && fwrite(data, 1, length, file) != length) {
+    fclose(file);
+    std::remove(path.c_str());
+    throw std::runtime_error("Failed to write segment");
+  }
+}
+
+}  // namespace
+
+void SegmentWriter::write(const std::string& path, const std::vector<SegmentBlock>& blocks) {
+  std::vector<SegmentEntry> entries;
+  entries.reserve(blocks.size());
+
+  for (const auto& block : blocks) {
+    SegmentEntry entry;
+    entry.id = block.id;
+    entry.length = block.length;
+
+    // Legacy snappy wrapped buffers keep an unknown time range and are always decoded
+    BufferHeader header;
+
+    if (block.length > 0 && block.data[0] != SNAPPY) {
+      if (!header.read(block.data, block.length)) {
+        throw std::runtime_error("Invalid buffer for series " + block.id);
+      }
+
+      entry.count = header.itemCount;
+
+      if (header.hasTimeBounds) {
+        entry.minTimestamp = header.minTimestamp;
+        entry.maxTimestamp = header.maxTimestamp;
+      }
+    }
+
+    entries.push_back(entry);
+  }
+
+  // Sort the blocks by series and time, keeping the order of blocks that tie
+  std::vector<size_t> order(blocks.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    if (entries[a].id != entries[b].id) return entries[a].id < entries[b].id;
+    return entries[a].minTimestamp < entries[b].minTimestamp;
+  });
+
+  const std::string temporaryPath = path + ".tmp";
+  FILE* file = fopen(temporaryPath.c_str(), "wb");
+  if (!file) throw std::runtime_error("Failed to open " + temporaryPath);
+
+  std::vector<uint8_t> prefix;
+  append<uint32_t>(prefix, magic);
+  append<uint32_t>(prefix, version);
+  writeAll(file, prefix.data(), prefix.size(), temporaryPath);
+
+  uint64_t offset = prefix.size();
+  const uint8_t padding[8] = {};
+
+  std::vector<uint8_t> index;
+
+  for (size_t i : order) {
+    const size_t paddingLength = (8 - offset % 8) % 8;
+    writeAll(file, padding, paddingLength, temporaryPath);
+    offset += paddingLength;
+
+    writeAll(file, blocks[i].data, blocks[i].length, temporaryPath);
+
+    const SegmentEntry& entry = entries[i];
+
+    append<uint32_t>(index, entry.id.size());
+    index.insert(index.end(), entry.id.begin(), entry.id.end());
+    append<uint64_t>(index, offset);
+    append<uint64_t>(index, entry.length);
+    append<uint32_t>(index, entry.count);
+    append<uint64_t>(index, entry.minTimestamp);
+    append<uint64_t>(index, entry.maxTimestamp);
+
+    offset += entry.length;
+  }
+
+  append<uint64_t>(index, offset);
+  append<uint32_t>(index, index.size() - sizeof(uint64_t));
+  append<uint32_t>(index, entries.size());
+  append<uint32_t>(index, magic);
+
+  writeAll(file, index.data(), index.size(), temporaryPath);
+
+  if (fclose(file) != 0 || std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+    std::remove(temporaryPath.c_str());
+    throw std::runtime_error("Failed to write segment");
+  }
+}
+
+MappedSegment::MappedSegment(const std::string& path) {
+#ifndef _WIN32
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("Failed to open " + path);
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw std::runtime_error("Failed to open " + path);
+  }
+
+  length = info.st_size;
+
+  if (length > 0) {
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Failed to map " + path);
+    }
+
+    data = static_cast<const uint8_t*>(mapped);
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+#else
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) throw std::runtime_error("Failed to open " + path);
+
+  uint8_t chunk[65536];
+  size_t read;
+
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) fallback.insert(fallback.end(), chunk, chunk + read);
+
+  fclose(file);
+
+  data = fallback.data();
+  length = fallback.size();
+#endif
+
+  try {
+    parseIndex();
+  } catch (...) {
+#ifndef _WIN32
+    if (data) munmap(const_cast<uint8_t*>(data), length);
+#endif
+    throw;
+  }
+}
+
+MappedSegment::~MappedSegment() {
+#ifndef _WIN32
+  if (data) munmap(const_cast<uint8_t*>(data), length);
+#endif
+}
+
+void MappedSegment::parseIndex() {
+  const size_t prefixSize = 2 * sizeof(uint32_t);
+
+  if (length < prefixSize + SegmentWriter::footerSize) throw std::runtime_error("Invalid segment");
+
+  size_t offset = 0;
+  if (load<uint32_t>(data, length, offset) != SegmentWriter::magic) throw std::runtime_error("Invalid segment");
+  if (load<uint32_t>(data, length, offset) != SegmentWriter::version) {
+    throw std::runtime_error("Unsupported segment version");
+  }
+
+  // Only the footer and the index are read, blocks stay untouched until decoded
+  offset = length - SegmentWriter::footerSize;
+
+  const uint64_t indexOffset = load<uint64_t>(data, length, offset);
+  const uint32_t indexLength = load<uint32_t>(data, length, offset);
+  const uint32_t entryCount = load<uint32_t>(data, length, offset);
+
+  if (load<uint32_t>(data, length, offset) != SegmentWriter::magic) throw std::runtime_error("Invalid segment");
+
+  const size_t indexEnd = length - SegmentWriter::footerSize;
+
+  if (indexOffset < prefixSize || indexOffset > indexEnd || indexEnd - indexOffset != indexLength) {
+    throw std::runtime_error("Invalid segment index");
+  }
+
+  // Each entry takes at least its fixed fields, so a forged count cannot reserve more than the index holds
+  constexpr size_t minEntrySize = 4 * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
+  if (entryCount > indexLength / minEntrySize) throw std::runtime_error("Invalid segment index");
+
+  entries.resize(entryCount);
+  offset = indexOffset;
+
+  for (auto& entry : entries) {
+    const uint32_t idLength = load<uint32_t>(data, indexEnd, offset);
+    if (indexEnd - offset < idLength) throw std::runtime_error("Invalid segment index");
+
+    entry.id.assign(reinterpret_cast<const char*>(data + offset), idLength);
+    offset += idLength;
+
+    entry.offset = load<uint64_t>(data, indexEnd, offset);
+    entry.length = load<uint64_t>(data, indexEnd, offset);
+    entry.count = load<uint32_t>(data, indexEnd, offset);
+    entry.minTimestamp = load<uint64_t>(data, indexEnd, offset);
+    entry.maxTimestamp = load<uint64_t>(data, indexEnd, offset);
+
+    if (entry.offset < prefixSize || entry.offset > indexOffset || indexOffset - entry.offset < entry.length) {
+      throw std::runtime_error("Invalid segment index");
+    }
+  }
+
+  const auto ordered = [](const SegmentEntry& a, const SegmentEntry& b) { return a.id < b.id; };
+
+  if (!std::is_sorted(entries.begin(), entries.end(), ordered)) throw std::runtime_error("Invalid segment index");
+}
+
+std::pair<std::vector<SegmentEntry>::const_iterator, std::vector<SegmentEntry>::const_iterator> MappedSegment::find(
+    const std::string& id) const {
+  SegmentEntry key;
+  key.id = id;
+
+  return std::equal_range(entries.begin(), entries.end(), key,
+                          [](const SegmentEntry& a, const SegmentEntry& b) { return a.id < b.id; });
+}
+
+void MappedSegment::prefetch(const SegmentEntry& entry) const {
+#ifndef _WIN32
+  if (entry.length == 0) return;
+
+  const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+  const uintptr_t start = reinterpret_cast<uintptr_t>(data + entry.offset) & ~(pageSize - 1);
+  const uintptr_t end = reinterpret_cast<uintptr_t>(data + entry.offset + entry.length);
+
+  madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED);
+#endif
+}
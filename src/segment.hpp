@@ -0,0 +1,77 @@
+#ifndef __SEGMENT_H_INCLUDED__
+#define __SEGMENT_H_INCLUDED__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A segment packs many encoded buffers (blocks) into one file, followed by an
+// index of the series and time range held by each block.
+//
+// Layout:
+//   [uint32 magic][uint32 version]
+//   [block]... each starting on an 8 byte boundary
+//   [index entry]... sorted by series id, then min timestamp
+//   [uint64 index offset][uint32 index byte length][uint32 entry count][uint32 magic]
+//
+// Index entry:
+//   [uint32 id byte length][id][uint64 block offset][uint64 block length]
+//   [uint32 item count][uint64 min timestamp][uint64 max timestamp]
+struct SegmentEntry {
+  std::string id;
+  uint64_t offset = 0;
+  uint64_t length = 0;
+  uint32_t count = 0;
+  uint64_t minTimestamp = 0;
+  uint64_t maxTimestamp = UINT64_MAX;
+
+  bool overlaps(uint64_t from, uint64_t to) const { return minTimestamp <= to && maxTimestamp >= from; }
+};
+
+// An encoded buffer to be written into a segment, the data must outlive the write
+struct SegmentBlock {
+  std::string id;
+  const uint8_t* data;
+  size_t length;
+};
+
+class SegmentWriter {
+ public:
+  static constexpr uint32_t magic = 0x47534731;  // "GSG1"
+  static constexpr uint32_t version = 1;
+  static constexpr size_t footerSize = sizeof(uint64_t) + 3 * sizeof(uint32_t);
+
+  // Writes the blocks to a temporary file and renames it over path, throws std::runtime_error on failure
+  static void write(const std::string& path, const std::vector<SegmentBlock>& blocks);
+};
+
+// A read-only segment mapped into memory, blocks are decoded straight from the mapped pages
+class MappedSegment {
+ private:
+  const uint8_t* data = nullptr;
+  size_t length = 0;
+  std::vector<uint8_t> fallback;
+
+  void parseIndex();
+
+ public:
+  std::vector<SegmentEntry> entries;
+
+  // Maps the file and reads its index, throws std::runtime_error if it is not a valid segment
+  explicit MappedSegment(const std::string& path);
+  ~MappedSegment();
+
+  MappedSegment(const MappedSegment&) = delete;
+  MappedSegment& operator=(const MappedSegment&) = delete;
+
+  // Index entries of one series, in time order
+  std::pair<std::vector<SegmentEntry>::const_iterator, std::vector<SegmentEntry>::const_iterator> find(
+      const std::string& id) const;
+
+  const uint8_t* blockData(const SegmentEntry& entry) const { return data + entry.offset; }
+
+  // Hints the kernel to start paging a block in ahead of decoding it
+  void prefetch(const SegmentEntry& entry) const;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "simple8b.hpp"
 #include "util.hpp"
 
+#include <cstring>
 #include <iostream>
 
 AlignedBuffer Simple8B::encode(std::vector<uint64_t> &values) {
@@ -82,69 +83,39 @@ AlignedBuffer Simple8B::encode(std::vector<uint64_t> &values) {
 
 std::vector<uint64_t> Simple8B::decode(Slice &encoded) {
   std::vector<uint64_t> values;
+  uint64_t unpacked[maxPerWord];
 
   const size_t length = encoded.length<uint64_t>();
 
   for (unsigned int i = 0; i < length; i++) {
-    uint64_t packedValue = encoded.read<uint64_t>();
-    uint64_t selector = packedValue >> 60;
-
-    // TODO: Handling of bad selector values
-    switch (selector) {
-    case 0:
-      unpack<240, 0>(packedValue, values);
-      break;
-    case 1:
-      unpack<120, 0>(packedValue, values);
-      break;
-    case 2:
-      unpack<60, 1>(packedValue, values);
-      break;
-    case 3:
-      unpack<30, 2>(packedValue, values);
-      break;
-    case 4:
-      unpack<20, 3>(packedValue, values);
-      break;
-    case 5:
-      unpack<15, 4>(packedValue, values);
-      break;
-    case 6:
-      unpack<12, 5>(packedValue, values);
-      break;
-    case 7:
-      unpack<10, 6>(packedValue, values);
-      break;
-    case 8:
-      unpack<8, 7>(packedValue, values);
-      break;
-    case 9:
-      unpack<7, 8>(packedValue, values);
-      break;
-    case 10:
-      unpack<6, 10>(packedValue, values);
-      break;
-    case 11:
-      unpack<5, 12>(packedValue, values);
-      break;
-    case 12:
-      unpack<4, 15>(packedValue, values);
-      break;
-    case 13:
-      unpack<3, 20>(packedValue, values);
-      break;
-    case 14:
-      unpack<2, 30>(packedValue, values);
-      break;
-    case 15:
-      unpack<1, 60>(packedValue, values);
-      break;
-    }
+    const size_t count = unpack(encoded.read<uint64_t>(), unpacked);
+    values.insert(values.end(), unpacked, unpacked + count);
   }
 
   return values;
 }
 
+size_t Simple8B::count(const uint8_t *data, size_t length) {
+  size_t total = 0;
+
+  for (size_t offset = 0; offset + sizeof(uint64_t) <= length;
+       offset += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data + offset, sizeof(word));
+
+    total += visit(word, [](auto n, auto) { return decltype(n)::value; });
+  }
+
+  return total;
+}
+
+size_t Simple8B::unpack(uint64_t word, uint64_t *out) {
+  return visit(word, [&](auto n, auto bits) {
+    unpack<decltype(n)::value, decltype(bits)::value>(word, out);
+    return decltype(n)::value;
+  });
+}
+
 template <uint64_t n, uint64_t bits>
 bool Simple8B::canPack(std::vector<uint64_t> &values, int offset) {
   const size_t remaining = values.size() - offset;
@@ -180,15 +151,12 @@ uint64_t Simple8B::pack(std::vector<uint64_t> &values, size_t &offset) {
 }
 
 template <uint64_t n, uint64_t bits>
-void Simple8B::unpack(uint64_t value, std::vector<uint64_t> &out) {
+void Simple8B::unpack(uint64_t value, uint64_t *out) {
   const uint64_t mask = (1ull << bits) - 1;
 
-  // TODO: Validate fold expression
-
-  loop<int, n>([&out, value](auto i) {
+  loop<int, n>([out, value, mask](auto i) {
     constexpr int shiftAmount = i * bits;
 
-    uint64_t v = (value >> shiftAmount) & mask;
-    out.push_back(v);
+    out[i] = (value >> shiftAmount) & mask;
   });
 }
@@ -2,6 +2,7 @@
 #define __SIMPLE8B_H_INCLUDED__
 
 #include <cstdint>
+#include <type_traits>
 #include <vector>
 
 #include "aligned_buffer.hpp"
@@ -12,9 +13,23 @@ private:
 public:
   Simple8B(){};
 
+  // Most values a single word can hold
+  static constexpr size_t maxPerWord = 240;
+
   static AlignedBuffer encode(std::vector<uint64_t> &values);
   static std::vector<uint64_t> decode(Slice &encoded);
 
+  // Unpacks the values of one word into out, which must have room for
+  // maxPerWord values, and returns how many there were
+  static size_t unpack(uint64_t word, uint64_t *out);
+
+  // Values held by the whole words of data, read from the selectors alone
+  static size_t count(const uint8_t *data, size_t length);
+
+  // Calls f(n, bits) with the value count and width of the word's selector
+  // as std::integral_constant, so callers can unpack with constant shifts
+  template <class F> static inline auto visit(uint64_t word, F &&f);
+
   template <uint64_t n, uint64_t bits>
   static bool canPack(std::vector<uint64_t> &values, int offset);
 
@@ -22,7 +37,46 @@ public:
   static uint64_t pack(std::vector<uint64_t> &values, size_t &offset);
 
   template <uint64_t n, uint64_t bits>
-  static inline void unpack(uint64_t value, std::vector<uint64_t> &out);
+  static inline void unpack(uint64_t value, uint64_t *out);
 };
 
+template <class F> inline auto Simple8B::visit(uint64_t word, F &&f) {
+  using std::integral_constant;
+
+  switch (word >> 60) {
+  case 0:
+    return f(integral_constant<uint64_t, 240>{}, integral_constant<uint64_t, 0>{});
+  case 1:
+    return f(integral_constant<uint64_t, 120>{}, integral_constant<uint64_t, 0>{});
+  case 2:
+    return f(integral_constant<uint64_t, 60>{}, integral_constant<uint64_t, 1>{});
+  case 3:
+    return f(integral_constant<uint64_t, 30>{}, integral_constant<uint64_t, 2>{});
+  case 4:
+    return f(integral_constant<uint64_t, 20>{}, integral_constant<uint64_t, 3>{});
+  case 5:
+    return f(integral_constant<uint64_t, 15>{}, integral_constant<uint64_t, 4>{});
+  case 6:
+    return f(integral_constant<uint64_t, 12>{}, integral_constant<uint64_t, 5>{});
+  case 7:
+    return f(integral_constant<uint64_t, 10>{}, integral_constant<uint64_t, 6>{});
+  case 8:
+    return f(integral_constant<uint64_t, 8>{}, integral_constant<uint64_t, 7>{});
+  case 9:
+    return f(integral_constant<uint64_t, 7>{}, integral_constant<uint64_t, 8>{});
+  case 10:
+    return f(integral_constant<uint64_t, 6>{}, integral_constant<uint64_t, 10>{});
+  case 11:
+    return f(integral_constant<uint64_t, 5>{}, integral_constant<uint64_t, 12>{});
+  case 12:
+    return f(integral_constant<uint64_t, 4>{}, integral_constant<uint64_t, 15>{});
+  case 13:
+    return f(integral_constant<uint64_t, 3>{}, integral_constant<uint64_t, 20>{});
+  case 14:
+    return f(integral_constant<uint64_t, 2>{}, integral_constant<uint64_t, 30>{});
+  default:
+    return f(integral_constant<uint64_t, 1>{}, integral_constant<uint64_t, 60>{});
+  }
+}
+
 #endif
@@ -7,105 +7,6 @@
 #include <memory>
 #include <vector>
 
-class CompressedSlice {
-private:
-  size_t length_ = 0;
-  size_t offset = 0;
-  int bitOffset = 0;
-
-public:
-  const uint64_t *data = nullptr;
-
-  CompressedSlice(const uint8_t *_data, size_t _length)
-      : length_(_length / 8), data((uint64_t *)_data){};
-
-  template <typename T> T read(const int bits) {
-    if (bitOffset > 63) {
-      offset++;
-      bitOffset = 0;
-
-      if (offset >= length_) {
-        throw std::runtime_error("Out of bounds");
-      }
-    }
-
-    const int leftover_bits = bits - (64 - bitOffset);
-    const int bits_read = leftover_bits > 0 ? bits - leftover_bits : bits;
-    const uint64_t mask =
-        bits_read == 64 ? 0xffffffffffffffff : (1ull << bits_read) - 1;
-
-    uint64_t value = data[offset] >> bitOffset;
-    value &= mask;
-
-    if (leftover_bits > 0) {
-      offset++;
-      bitOffset = leftover_bits;
-
-      const uint64_t mask = leftover_bits == 64 ? 0xffffffffffffffff
-                                                : (1ull << leftover_bits) - 1;
-      value |= (data[offset] & mask) << bits_read;
-    } else {
-      bitOffset += bits;
-    }
-
-    return value;
-  };
-
-  template <typename T, int bits> T readFixed() {
-    if (bitOffset > 63) {
-      offset++;
-      bitOffset = 0;
-
-      if (offset >= length_) {
-        throw std::runtime_error("Out of bounds");
-      }
-    }
-
-    const int leftover_bits = bits - (64 - bitOffset);
-    const int bits_read = leftover_bits > 0 ? bits - leftover_bits : bits;
-    const uint64_t mask =
-        bits_read == 64 ? 0xffffffffffffffff : (1ull << bits_read) - 1;
-
-    uint64_t value = data[offset] >> bitOffset;
-    value &= mask;
-
-    if (leftover_bits > 0) {
-      offset++;
-      bitOffset = leftover_bits;
-
-      const uint64_t mask = leftover_bits == 64 ? 0xffffffffffffffff
-                                                : (1ull << leftover_bits) - 1;
-      value |= (data[offset] & mask) << bits_read;
-    } else {
-      bitOffset += bits;
-    }
-
-    return value;
-  };
-
-  bool readBit() {
-    if (bitOffset > 63) {
-      offset++;
-      bitOffset = 1;
-
-      if (offset >= length_) {
-        throw std::runtime_error("Out of bounds");
-      }
-
-      return (data[offset] & 1) == 1;
-    }
-
-    bool value = ((data[offset] >> bitOffset) & 1) == 1;
-    bitOffset++;
-
-    return value;
-  }
-
-  bool isAtEnd() {
-    return offset >= length_ || (offset == length_ - 1 && bitOffset > 63);
-  }
-};
-
 class Slice {
 public:
   const uint8_t *data;
@@ -144,15 +45,6 @@ public:
     return slice;
   }
 
-  CompressedSlice getCompressedSlice(size_t byteLength) {
-    const uint8_t *ref = data + offset;
-    CompressedSlice slice(ref, byteLength);
-
-    offset += byteLength;
-
-    return slice;
-  }
-
   template <class T> T read(size_t offset) {
     T value;
 
@@ -0,0 +1,75 @@
+#include "stats.hpp"
+#include "util.hpp"
+
+std::atomic<bool> Stats::enabled{true};
+
+Histogram Stats::stages[STAGE_COUNT];
+Histogram Stats::encodeTypes[Stats::typeCount];
+Histogram Stats::decodeTypes[Stats::typeCount];
+
+void Histogram::record(uint64_t ns, uint64_t byteCount) {
+  // Smallest power of two that is at least ns
+  int bucket = ns <= 1 ? 0 : 64 - getLeadingZeroBits(ns - 1);
+  if (bucket >= bucketCount) bucket = bucketCount - 1;
+
+  count.fetch_add(1, std::memory_order_relaxed);
+  totalNs.fetch_add(ns, std::memory_order_relaxed);
+  bytes.fetch_add(byteCount, std::memory_order_relaxed);
+  buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Histogram::reset() {
+  count = 0;
+  totalNs = 0;
+  bytes = 0;
+
+  for (auto& bucket : buckets) bucket = 0;
+}
+
+bool Stats::compiled() {
+#ifdef GORILLA_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+const char* Stats::stageName(Stage stage) {
+  switch (stage) {
+    case STAGE_MARSHAL:
+      return "marshal";
+    case STAGE_TIMESTAMP_ENCODE:
+      return "timestampEncode";
+    case STAGE_VALUE_ENCODE:
+      return "valueEncode";
+    case STAGE_OUTPUT:
+      return "output";
+    case STAGE_INPUT_COPY:
+      return "inputCopy";
+    case STAGE_TIMESTAMP_DECODE:
+      return "timestampDecode";
+    case STAGE_VALUE_DECODE:
+      return "valueDecode";
+    case STAGE_SNAPPY:
+      return "snappy";
+    case STAGE_RESULT_BUILD:
+      return "resultBuild";
+    default:
+      return "unknown";
+  }
+}
+
+void Stats::record(Stage stage, uint8_t type, uint64_t ns, uint64_t bytes) {
+  stages[stage].record(ns, bytes);
+
+  if (type < typeCount) {
+    if (stage == STAGE_VALUE_ENCODE) encodeTypes[type].record(ns, bytes);
+    if (stage == STAGE_VALUE_DECODE) decodeTypes[type].record(ns, bytes);
+  }
+}
+
+void Stats::reset() {
+  for (auto& histogram : stages) histogram.reset();
+  for (auto& histogram : encodeTypes) histogram.reset();
+  for (auto& histogram : decodeTypes) histogram.reset();
+}
@@ -0,0 +1,169 @@
+#ifndef __STATS_H_INCLUDED__
+#define __STATS_H_INCLUDED__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+#include "probes.hpp"
+
+enum Stage : uint8_t {
+  STAGE_MARSHAL = 0,
+  STAGE_TIMESTAMP_ENCODE,
+  STAGE_VALUE_ENCODE,
+  STAGE_OUTPUT,
+  STAGE_INPUT_COPY,
+  STAGE_TIMESTAMP_DECODE,
+  STAGE_VALUE_DECODE,
+  STAGE_SNAPPY,
+  STAGE_RESULT_BUILD,
+  STAGE_COUNT
+};
+
+// Cumulative timings of one stage, bucketed by powers of two nanoseconds
+class Histogram {
+ private:
+ public:
+  static constexpr int bucketCount = 40;
+
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> totalNs{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> buckets[bucketCount] = {};
+
+  void record(uint64_t ns, uint64_t byteCount);
+  void reset();
+
+  // Upper bound of a bucket in nanoseconds
+  static uint64_t bucketLimit(int bucket) { return 1ull << bucket; }
+};
+
+class Stats {
+ private:
+ public:
+  // Value timings are also kept per CompressionType below this value
+  static constexpr int typeCount = 32;
+
+  static std::atomic<bool> enabled;
+
+  static Histogram stages[STAGE_COUNT];
+  static Histogram encodeTypes[typeCount];
+  static Histogram decodeTypes[typeCount];
+
+  static bool compiled();
+  static const char* stageName(Stage stage);
+  static void record(Stage stage, uint8_t type, uint64_t ns, uint64_t bytes);
+  static void reset();
+};
+
+// Fires the USDT probe pair of a stage, see probes.hpp
+inline void probeStageStart(Stage stage, uint64_t points, uint64_t bytes) {
+  switch (stage) {
+    case STAGE_MARSHAL: GORILLA_PROBE_START(marshal, points, bytes); break;
+    case STAGE_TIMESTAMP_ENCODE: GORILLA_PROBE_START(timestamp_encode, points, bytes); break;
+    case STAGE_VALUE_ENCODE: GORILLA_PROBE_START(value_encode, points, bytes); break;
+    case STAGE_OUTPUT: GORILLA_PROBE_START(output, points, bytes); break;
+    case STAGE_INPUT_COPY: GORILLA_PROBE_START(input_copy, points, bytes); break;
+    case STAGE_TIMESTAMP_DECODE: GORILLA_PROBE_START(timestamp_decode, points, bytes); break;
+    case STAGE_VALUE_DECODE: GORILLA_PROBE_START(value_decode, points, bytes); break;
+    case STAGE_SNAPPY: GORILLA_PROBE_START(snappy, points, bytes); break;
+    case STAGE_RESULT_BUILD: GORILLA_PROBE_START(result_build, points, bytes); break;
+    default: break;
+  }
+}
+
+inline void probeStageDone(Stage stage, uint64_t points, uint64_t bytes, uint8_t type) {
+  switch (stage) {
+    case STAGE_MARSHAL: GORILLA_PROBE_DONE(marshal, points, bytes, type); break;
+    case STAGE_TIMESTAMP_ENCODE: GORILLA_PROBE_DONE(timestamp_encode, points, bytes, type); break;
+    case STAGE_VALUE_ENCODE: GORILLA_PROBE_DONE(value_encode, points, bytes, type); break;
+    case STAGE_OUTPUT: GORILLA_PROBE_DONE(output, points, bytes, type); break;
+    case STAGE_INPUT_COPY: GORILLA_PROBE_DONE(input_copy, points, bytes, type); break;
+    case STAGE_TIMESTAMP_DECODE: GORILLA_PROBE_DONE(timestamp_decode, points, bytes, type); break;
+    case STAGE_VALUE_DECODE: GORILLA_PROBE_DONE(value_decode, points, bytes, type); break;
+    case STAGE_SNAPPY: GORILLA_PROBE_DONE(snappy, points, bytes, type); break;
+    case STAGE_RESULT_BUILD: GORILLA_PROBE_DONE(result_build, points, bytes, type); break;
+    default: break;
+  }
+}
+
+// Times a scope and records it against a stage when it ends. Both ends of the
+// scope fire the stage's USDT probes with the point count and byte size, and
+// setBytes() replaces the size reported at the end, e.g. with the encoded size.
+// Sizes that walk the data are passed as a function, which only runs when the
+// stage is recorded or its probes are compiled in
+class StageTimer {
+ private:
+  Stage stage;
+  uint8_t type = Stats::typeCount;
+  uint64_t points;
+  uint64_t bytes;
+  bool stopped = false;
+
+#ifdef GORILLA_STATS
+  using clock = std::chrono::steady_clock;
+
+  bool active;
+  clock::time_point start;
+#endif
+
+ public:
+  StageTimer(Stage _stage, uint64_t _points = 0, uint64_t _bytes = 0)
+      : stage(_stage), points(_points), bytes(_bytes) {
+    probeStageStart(stage, points, bytes);
+
+#ifdef GORILLA_STATS
+    active = Stats::enabled.load(std::memory_order_relaxed);
+    if (active) start = clock::now();
+#endif
+  }
+
+  template <class Measure, std::enable_if_t<std::is_invocable_v<Measure>, int> = 0>
+  StageTimer(Stage _stage, uint64_t _points, Measure&& measure)
+      : StageTimer(_stage, _points, measuring() ? static_cast<uint64_t>(measure()) : 0) {}
+
+  ~StageTimer() { stop(); }
+
+  // Whether a stage started now would report its byte size anywhere
+  static bool measuring() {
+#if defined(GORILLA_HAS_USDT)
+    return true;
+#elif defined(GORILLA_STATS)
+    return Stats::enabled.load(std::memory_order_relaxed);
+#else
+    return false;
+#endif
+  }
+
+  // Ends the stage now instead of at the end of the scope
+  void stop() {
+    if (stopped) return;
+    stopped = true;
+
+    probeStageDone(stage, points, bytes, type);
+
+#ifdef GORILLA_STATS
+    if (!active) return;
+
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+    Stats::record(stage, type, ns, bytes);
+#endif
+  }
+
+  void setBytes(uint64_t _bytes) { bytes = _bytes; }
+
+  template <class Measure, std::enable_if_t<std::is_invocable_v<Measure>, int> = 0>
+  void setBytes(Measure&& measure) {
+#if defined(GORILLA_HAS_USDT)
+    bytes = measure();
+#elif defined(GORILLA_STATS)
+    if (active) bytes = measure();
+#else
+    (void)measure;
+#endif
+  }
+  void setType(uint8_t _type) { type = _type; }
+};
+
+#endif
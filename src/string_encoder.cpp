@@ -0,0 +1,304 @@
+#include "string_encoder.hpp"
+#include "simple8b.hpp"
+#include "stats.hpp"
+
+#include <snappy.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+// Snappy layout:
+//   snappy compressed ([uint32 length][bytes])...
+//
+// Dictionary layout:
+//   [uint32 entry count] ([uint32 length][bytes])... [uint32 codes byte length][Simple8B codes]
+//
+// Front coded layout:
+//   [uint8 flags][uint32 byte length][Simple8B prefix lengths]
+//   [uint32 byte length][Simple8B suffix lengths][suffix bytes, optionally snappy compressed]
+
+enum FrontCodedFlags : uint8_t { SNAPPY_SUFFIXES = 1 };
+
+namespace {
+
+// Reads the uint32 length at offset and moves past it and the bytes it counts,
+// false if either runs past the end
+bool skipSection(const uint8_t* data, size_t length, size_t& offset, uint32_t& sectionLength) {
+  if (length - offset < sizeof(uint32_t)) return false;
+
+  std::memcpy(&sectionLength, data + offset, sizeof(uint32_t));
+  offset += sizeof(uint32_t);
+
+  if (length - offset < sectionLength) return false;
+
+  offset += sectionLength;
+  return true;
+}
+
+}  // namespace
+
+void StringEncoder::encodeSnappy(const std::vector<std::string>& values, AlignedBuffer& out) {
+  std::string concatenatedData;
+
+  // Concatenate the strings into a binary buffer with a 32-bit unsigned int
+  // prefix for each string's length
+  for (const auto& str : values) {
+    uint32_t length = static_cast<uint32_t>(str.size());
+    concatenatedData.append(reinterpret_cast<char*>(&length), sizeof(length));
+    concatenatedData.append(str);
+  }
+
+  // Compress the data with Snappy
+  StageTimer snappyTimer(STAGE_SNAPPY, values.size(), concatenatedData.size());
+
+  std::string compressedData;
+  snappy::Compress(concatenatedData.data(), concatenatedData.size(), &compressedData);
+
+  snappyTimer.stop();
+
+  out.write(compressedData);
+}
+
+void StringEncoder::decodeSnappy(Slice& encoded, std::vector<std::string>& out, uint32_t size) {
+  // Decompress the data with Snappy
+  StageTimer snappyTimer(STAGE_SNAPPY, 0, encoded.bytesLeft());
+
+  std::string decompressedData;
+  if (!snappy::Uncompress(reinterpret_cast<const char*>(encoded.data + encoded.offset), encoded.bytesLeft(),
+                          &decompressedData)) {
+    throw std::runtime_error("Invalid data format");
+  }
+
+  encoded.offset = encoded.length_;
+  snappyTimer.stop();
+
+  // The strings are only counted once decompressed, so the section checks itself
+  const size_t begin = out.size();
+  size_t index = 0;
+
+  while (index + sizeof(uint32_t) <= decompressedData.size()) {
+    uint32_t length;
+    std::memcpy(&length, decompressedData.data() + index, sizeof(uint32_t));
+    index += sizeof(uint32_t);
+    if (length > decompressedData.size() - index) {
+      throw std::runtime_error("Invalid data format");
+    }
+    out.push_back(decompressedData.substr(index, length));
+    index += length;
+  }
+
+  if (index != decompressedData.size() || out.size() - begin != size) {
+    throw std::runtime_error("Invalid data format");
+  }
+}
+
+size_t StringEncoder::maxEncodedSize(const std::vector<std::string>& values) {
+  size_t rawBytes = 0;
+  for (const auto& value : values) rawBytes += sizeof(uint32_t) + value.size();
+
+  // Dictionaries and front coding write at most the raw bytes plus one
+  // Simple8B word for each code or length, snappy its worst case expansion
+  const size_t codedBytes = sizeof(uint8_t) + 2 * sizeof(uint32_t) + rawBytes + 2 * values.size() * sizeof(uint64_t);
+
+  return std::max(snappy::MaxCompressedLength(rawBytes), codedBytes);
+}
+
+bool StringEncoder::encodeDictionary(const std::vector<std::string>& values, AlignedBuffer& out) {
+  // Only use a dictionary when each entry is repeated on average at least twice
+  const size_t limit = std::min(maxDictionarySize, values.size() / 2);
+
+  std::unordered_map<std::string, uint64_t> lookup;
+  std::vector<const std::string*> dictionary;
+  std::vector<uint64_t> codes;
+  codes.reserve(values.size());
+
+  for (const auto& value : values) {
+    auto it = lookup.find(value);
+
+    if (it == lookup.end()) {
+      if (dictionary.size() >= limit) return false;
+
+      it = lookup.emplace(value, dictionary.size()).first;
+      dictionary.push_back(&it->first);
+    }
+
+    codes.push_back(it->second);
+  }
+
+  out.write(static_cast<uint32_t>(dictionary.size()));
+
+  for (const std::string* entry : dictionary) {
+    out.write(static_cast<uint32_t>(entry->size()));
+    out.write(*entry);
+  }
+
+  AlignedBuffer codesBuffer = Simple8B::encode(codes);
+  out.write(static_cast<uint32_t>(codesBuffer.size()));
+  out.write(codesBuffer);
+
+  return true;
+}
+
+void StringEncoder::decodeDictionary(Slice& encoded, std::vector<std::string>& dictionary,
+                                     std::vector<uint64_t>& codes, uint32_t size) {
+  const uint32_t entries = encoded.read<uint32_t>();
+  dictionary.reserve(entries);
+
+  for (uint32_t i = 0; i < entries; i++) {
+    const uint32_t length = encoded.read<uint32_t>();
+    dictionary.push_back(encoded.readString(length));
+  }
+
+  const uint32_t codesLength = encoded.read<uint32_t>();
+  Slice codesSlice = encoded.getSlice(codesLength);
+
+  codes = Simple8B::decode(codesSlice);
+
+  if (codes.size() != size) {
+    throw std::runtime_error("Invalid data format");
+  }
+
+  for (uint64_t code : codes) {
+    if (code >= entries) {
+      throw std::runtime_error("Invalid data format");
+    }
+  }
+}
+
+bool StringEncoder::encodeFrontCoded(const std::vector<std::string>& values, AlignedBuffer& out) {
+  std::vector<uint64_t> prefixLengths;
+  std::vector<uint64_t> suffixLengths;
+  prefixLengths.reserve(values.size());
+  suffixLengths.reserve(values.size());
+
+  std::string suffixes;
+  size_t totalBytes = 0;
+  const std::string* previous = nullptr;
+
+  for (const auto& value : values) {
+    size_t prefix = 0;
+
+    if (previous != nullptr) {
+      const size_t maxPrefix = std::min(previous->size(), value.size());
+      prefix = std::mismatch(value.begin(), value.begin() + maxPrefix, previous->begin()).first - value.begin();
+    }
+
+    prefixLengths.push_back(prefix);
+    suffixLengths.push_back(value.size() - prefix);
+    suffixes.append(value, prefix, std::string::npos);
+
+    totalBytes += value.size();
+    previous = &value;
+  }
+
+  // Front coding only pays off when neighbours share a good part of their bytes
+  if ((totalBytes - suffixes.size()) * 4 < totalBytes) return false;
+
+  // Keep the snappy pass only when it saves at least an eighth of the suffix bytes
+  StageTimer snappyTimer(STAGE_SNAPPY, values.size(), suffixes.size());
+
+  std::string compressedSuffixes;
+  snappy::Compress(suffixes.data(), suffixes.size(), &compressedSuffixes);
+
+  snappyTimer.stop();
+
+  const bool useSnappy = compressedSuffixes.size() < suffixes.size() - suffixes.size() / 8;
+
+  out.write(static_cast<uint8_t>(useSnappy ? SNAPPY_SUFFIXES : 0));
+
+  AlignedBuffer prefixBuffer = Simple8B::encode(prefixLengths);
+  out.write(static_cast<uint32_t>(prefixBuffer.size()));
+  out.write(prefixBuffer);
+
+  AlignedBuffer suffixBuffer = Simple8B::encode(suffixLengths);
+  out.write(static_cast<uint32_t>(suffixBuffer.size()));
+  out.write(suffixBuffer);
+
+  out.write(useSnappy ? compressedSuffixes : suffixes);
+
+  return true;
+}
+
+void StringEncoder::decodeFrontCoded(Slice& encoded, std::vector<std::string>& out, uint32_t size) {
+  const uint8_t flags = encoded.read<uint8_t>();
+
+  const uint32_t prefixLength = encoded.read<uint32_t>();
+  Slice prefixSlice = encoded.getSlice(prefixLength);
+  std::vector<uint64_t> prefixLengths = Simple8B::decode(prefixSlice);
+
+  const uint32_t suffixLength = encoded.read<uint32_t>();
+  Slice suffixSlice = encoded.getSlice(suffixLength);
+  std::vector<uint64_t> suffixLengths = Simple8B::decode(suffixSlice);
+
+  std::string uncompressed;
+  const char* suffixes = reinterpret_cast<const char*>(encoded.data + encoded.offset);
+  size_t suffixesLength = encoded.bytesLeft();
+
+  if (flags & SNAPPY_SUFFIXES) {
+    StageTimer snappyTimer(STAGE_SNAPPY, size, suffixesLength);
+
+    if (!snappy::Uncompress(suffixes, suffixesLength, &uncompressed)) {
+      throw std::runtime_error("Invalid data format");
+    }
+
+    suffixes = uncompressed.data();
+    suffixesLength = uncompressed.size();
+  }
+
+  out.reserve(size);
+
+  size_t index = 0;
+
+  for (uint32_t i = 0; i < size; i++) {
+    const size_t prefix = prefixLengths[i];
+    const size_t suffix = suffixLengths[i];
+
+    if ((i == 0 ? prefix != 0 : prefix > out.back().size()) || suffix > suffixesLength - index) {
+      throw std::runtime_error("Invalid data format");
+    }
+
+    std::string value;
+    value.reserve(prefix + suffix);
+
+    if (prefix > 0) value.append(out.back(), 0, prefix);
+    value.append(suffixes + index, suffix);
+
+    index += suffix;
+    out.push_back(std::move(value));
+  }
+}
+
+bool StringEncoder::validateDictionary(const uint8_t* data, size_t length, uint32_t size) {
+  if (length < sizeof(uint32_t)) return false;
+
+  uint32_t entries;
+  std::memcpy(&entries, data, sizeof(uint32_t));
+
+  size_t offset = sizeof(uint32_t);
+  uint32_t sectionLength;
+
+  for (uint32_t i = 0; i < entries; i++) {
+    if (!skipSection(data, length, offset, sectionLength)) return false;
+  }
+
+  if (!skipSection(data, length, offset, sectionLength)) return false;
+
+  return Simple8B::count(data + offset - sectionLength, sectionLength) == size;
+}
+
+bool StringEncoder::validateFrontCoded(const uint8_t* data, size_t length, uint32_t size) {
+  if (length < sizeof(uint8_t)) return false;
+
+  size_t offset = sizeof(uint8_t);
+  uint32_t sectionLength;
+
+  // The prefix lengths, then the suffix lengths
+  for (int i = 0; i < 2; i++) {
+    if (!skipSection(data, length, offset, sectionLength)) return false;
+    if (Simple8B::count(data + offset - sectionLength, sectionLength) < size) return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,41 @@
+#ifndef __STRING_ENCODER_H_INCLUDED__
+#define __STRING_ENCODER_H_INCLUDED__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "aligned_buffer.hpp"
+#include "slice_buffer.hpp"
+
+class StringEncoder {
+ private:
+ public:
+  StringEncoder(){};
+
+  // Dictionaries larger than this are not worth it over snappy
+  static constexpr size_t maxDictionarySize = 4096;
+
+  // Upper bound of the encoded size of values with any of the layouts below
+  static size_t maxEncodedSize(const std::vector<std::string>& values);
+
+  static bool encodeDictionary(const std::vector<std::string>& values, AlignedBuffer& out);
+  static void decodeDictionary(Slice& encoded, std::vector<std::string>& dictionary, std::vector<uint64_t>& codes,
+                               uint32_t size);
+
+  static void encodeSnappy(const std::vector<std::string>& values, AlignedBuffer& out);
+
+  // Throws std::runtime_error unless the section holds exactly size strings
+  static void decodeSnappy(Slice& encoded, std::vector<std::string>& out, uint32_t size);
+
+  static bool encodeFrontCoded(const std::vector<std::string>& values, AlignedBuffer& out);
+  static void decodeFrontCoded(Slice& encoded, std::vector<std::string>& out, uint32_t size);
+
+  // Check the lengths and the Simple8B selectors of a dictionary or front
+  // coded section, false if it cannot hold size values. The decoders trust
+  // sections that passed and only check the codes and lengths themselves
+  static bool validateDictionary(const uint8_t* data, size_t length, uint32_t size);
+  static bool validateFrontCoded(const uint8_t* data, size_t length, uint32_t size);
+};
+
+#endif
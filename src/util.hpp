@@ -5,6 +5,7 @@
 #include <vector>
 #include <algorithm>
 #include <numeric>
+#include <string>
 
 #include <type_traits>
 #include <utility>
@@ -1,10 +1,22 @@
 import { describe, it } from "node:test";
 import assert from "node:assert/strict";
 
+import { mkdtempSync, readFileSync, rmSync, writeFileSync } from "node:fs";
+import { tmpdir } from "node:os";
+import { join } from "node:path";
 import { createRequire } from "module";
 const require = createRequire(import.meta.url);
 const GorillaCodec = require("../lib/binding.js");
 
+// Whether the linked snappy shrinks text that only it can, byte planes only
+// beat raw doubles with one that does
+const snappyCompresses = await (async () => {
+  const values = Array.from({ length: 64 }, (_, i) => `${i} ${"compressible ".repeat(8)}`);
+  const encodeResult = await GorillaCodec.encode({ timestamps: values.map((_, i) => i), values });
+
+  return GorillaCodec.inspect(encodeResult).valueBytes < values.join("").length;
+})();
+
 describe("Errors", () => {
   it("No values", async () => {
     const timestamps = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10];
@@ -121,6 +133,72 @@ describe("Integer", () => {
 
     assert.deepStrictEqual(decodeResult, { timestamps, values });
   });
+
+  it("Packs timestamps with gaps in PFOR blocks", async () => {
+    for (const count of [3, 130, 131, 5000]) {
+      const timestamps = [];
+      const values = [];
+
+      let timestamp = 1704747969000;
+      for (let i = 0; i < count; i++) {
+        timestamp += i % 300 === 299 ? 3600000 + i : 10000;
+        timestamps.push(timestamp);
+        values.push(i);
+      }
+
+      const encodeResult = await GorillaCodec.encode({ timestamps, values });
+      assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), { timestamps, values });
+
+      const decodedTimestamps = new Float64Array(count);
+      GorillaCodec.decodeInto(encodeResult, { timestamps: decodedTimestamps });
+      assert.deepStrictEqual(Array.from(decodedTimestamps), timestamps);
+
+      if (count === 5000) {
+        const { timestampType } = GorillaCodec.inspect(encodeResult);
+        assert.equal(timestampType, GorillaCodec.CompressionType.INTEGER_PFOR_ENCODER);
+      }
+    }
+  });
+});
+
+describe("Timestamps", () => {
+  it("Scales timestamps sharing a common stride", async () => {
+    const timestamps = [];
+    const values = [];
+
+    let timestamp = 1704747969000;
+    for (let i = 0; i < 100000; i++) {
+      timestamp += 1000 * (9 + Math.floor(Math.random() * 3));
+      timestamps.push(timestamp);
+      values.push(true);
+    }
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    const decodeResult = await GorillaCodec.decode(encodeResult);
+
+    assert.deepStrictEqual(decodeResult, { timestamps, values });
+
+    // A single timestamp off the stride disables scaling
+    const unscaledTimestamps = [...timestamps];
+    unscaledTimestamps[1] += 1;
+
+    const unscaledResult = await GorillaCodec.encode({
+      timestamps: unscaledTimestamps,
+      values,
+    });
+
+    assert.ok(encodeResult.length * 2 < unscaledResult.length);
+  });
+
+  it("Scales decreasing timestamps", async () => {
+    const timestamps = [5000, 3000, 9000, 1000, 1000, 7000];
+    const values = [1, 2, 3, 4, 5, 6];
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    const decodeResult = await GorillaCodec.decode(encodeResult);
+
+    assert.deepStrictEqual(decodeResult, { timestamps, values });
+  });
 });
 
 describe("String", () => {
@@ -159,6 +237,41 @@ describe("String", () => {
 
     assert.deepStrictEqual(decodeResult, { timestamps, values });
   });
+
+  it("Encodes a low cardinality string array", async () => {
+    const states = ["ok", "warning", "critical", "unknown", ""];
+    const timestamps = [];
+    const values = [];
+
+    for (let i = 0; i < 100000; i++) {
+      timestamps.push(i);
+      values.push(states[Math.floor(i / 7) % states.length]);
+    }
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    const decodeResult = await GorillaCodec.decode(encodeResult);
+
+    assert.deepStrictEqual(decodeResult, { timestamps, values });
+    assert.ok(encodeResult.length < values.length);
+  });
+
+  it("Encodes a string array with shared prefixes", async () => {
+    const timestamps = [];
+    const values = [];
+
+    for (let i = 0; i < 100000; i++) {
+      timestamps.push(i);
+      values.push(`/api/v1/series/${Math.floor(i / 3)}/points`);
+    }
+
+    values[10] = "";
+    values[11] = "/api";
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    const decodeResult = await GorillaCodec.decode(encodeResult);
+
+    assert.deepStrictEqual(decodeResult, { timestamps, values });
+  });
 });
 
 describe("Boolean", () => {
@@ -197,6 +310,50 @@ describe("Boolean", () => {
 
     assert.deepStrictEqual(decodeResult, { timestamps, values });
   });
+
+  it("Run length encodes a long lived boolean array", async () => {
+    const timestamps = [];
+    const values = [];
+
+    for (let i = 0; i < 1000000; i++) {
+      timestamps.push(i);
+      values.push(i < 400000 || i > 400100);
+    }
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    const decodeResult = await GorillaCodec.decode(encodeResult);
+
+    assert.deepStrictEqual(decodeResult, { timestamps, values });
+
+    // Bit packing the same series would take values.length / 8 bytes
+    const noisyResult = await GorillaCodec.encode({
+      timestamps,
+      values: values.map((x, i) => x !== (i % 2 === 0)),
+    });
+
+    assert.ok(encodeResult.length + values.length / 8 - 1000 < noisyResult.length);
+  });
+
+  it("Encodes and decodes Uint8Array booleans", async () => {
+    const timestamps = [];
+    const values = new Uint8Array(100003);
+
+    for (let i = 0; i < values.length; i++) {
+      timestamps.push(i);
+      values[i] = i % 3 === 0 ? 0 : i % 7;
+    }
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    const decodeResult = await GorillaCodec.decode(encodeResult, {
+      typedArrays: true,
+    });
+
+    assert.deepStrictEqual(decodeResult.timestamps, timestamps);
+    assert.deepStrictEqual(
+      decodeResult.values,
+      values.map((x) => (x !== 0 ? 1 : 0))
+    );
+  });
 });
 describe("Float", () => {
   it("Encodes a float array", async () => {
@@ -338,4 +495,766 @@ describe("Float", () => {
 
     assert.deepStrictEqual(decodeResult, { timestamps, values });
   });
+
+  it("Picks the smallest float codec from a sample", async () => {
+    const timestamps = [];
+    const values = [];
+    const bits = new DataView(new ArrayBuffer(8));
+
+    // Random bit patterns, which XOR encoding can only grow
+    for (let i = 0; i < 10000; i++) {
+      bits.setUint32(0, (Math.random() * 0x7fefffff) >>> 0);
+      bits.setUint32(4, (Math.random() * 0x100000000) >>> 0);
+
+      timestamps.push(i);
+      values.push(bits.getFloat64(0));
+    }
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    assert.equal(GorillaCodec.inspect(encodeResult).valueType, GorillaCodec.CompressionType.FLOAT_RAW_ENCODER);
+    assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), { timestamps, values });
+
+    const unsampledResult = await GorillaCodec.encode({ timestamps, values }, { sampleSize: 0 });
+    assert.equal(GorillaCodec.inspect(unsampledResult).valueType, GorillaCodec.CompressionType.FLOAT_ENCODER);
+    assert.ok(unsampledResult.length > encodeResult.length);
+    assert.deepStrictEqual(await GorillaCodec.decode(unsampledResult), { timestamps, values });
+  });
+
+  it("Encodes a Float32Array on 32 bit words", async () => {
+    for (const count of [1, 2, 7, 4001]) {
+      const timestamps = [];
+      const values = new Float32Array(count);
+
+      for (let i = 0; i < count; i++) {
+        timestamps.push(i * 1000);
+        values[i] = i % 50 === 49 ? NaN : Math.round(Math.sin(i / 40) * 2000) / 100;
+      }
+
+      const encodeResult = await GorillaCodec.encode({ timestamps, values });
+      assert.equal(GorillaCodec.inspect(encodeResult).valueType, GorillaCodec.CompressionType.FLOAT32_ENCODER);
+
+      assert.deepStrictEqual(await GorillaCodec.decode(encodeResult, { typedArrays: true }), { timestamps, values });
+      assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), { timestamps, values: Array.from(values) });
+
+      const decodedValues = new Float32Array(count);
+      const widenedValues = new Float64Array(count);
+
+      GorillaCodec.decodeInto(encodeResult, { values: decodedValues });
+      GorillaCodec.decodeInto(encodeResult, { values: widenedValues });
+
+      assert.deepStrictEqual(decodedValues, values);
+      assert.deepStrictEqual(widenedValues, Float64Array.from(values));
+
+      if (count === 4001) {
+        const doubleResult = await GorillaCodec.encode({ timestamps, values: Array.from(values) }, { sampleSize: 0 });
+        assert.ok(GorillaCodec.inspect(encodeResult).valueBytes < GorillaCodec.inspect(doubleResult).valueBytes);
+      }
+    }
+
+    const doubleResult = await GorillaCodec.encode({ timestamps: [1], values: [1.5] });
+    assert.throws(() => GorillaCodec.decodeInto(doubleResult, { values: new Float32Array(1) }), TypeError);
+  });
+
+  it("Round trips entropy coded control fields", async () => {
+    for (const count of [1, 2, 5, 3000]) {
+      const timestamps = [];
+      const values = [];
+
+      for (let i = 0; i < count; i++) {
+        timestamps.push(i * 1000);
+        values.push(i % 89 === 5 ? null : Math.round(Math.sin(i / 30) * 1000) / 10 + (i % 7 === 0 ? 0.001 : 0));
+      }
+
+      const encodeResult = await GorillaCodec.encode({ timestamps, values }, { highRatio: true, sampleSize: 0 });
+      assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), { timestamps, values });
+
+      const decodedValues = new Float64Array(count);
+      GorillaCodec.decodeInto(encodeResult, { values: decodedValues });
+      assert.deepStrictEqual(Array.from(decodedValues, (value) => (Number.isNaN(value) ? null : value)), values);
+    }
+
+    const timestamps = Array.from({ length: 4000 }, (_, i) => i);
+    const values = timestamps.map((i) => Math.round(Math.sin(i / 50) * 100) / 100);
+
+    const defaultResult = await GorillaCodec.encode({ timestamps, values }, { sampleSize: 0 });
+    const highRatioResult = await GorillaCodec.encode({ timestamps, values }, { highRatio: true, sampleSize: 0 });
+
+    assert.equal(GorillaCodec.inspect(highRatioResult).valueType, GorillaCodec.CompressionType.FLOAT_ENTROPY_ENCODER);
+    assert.ok(highRatioResult.length < defaultResult.length);
+    assert.throws(() => GorillaCodec.encode({ timestamps: [1], values: [1.5] }, { highRatio: 1 }), TypeError);
+  });
+
+  it("Picks the FPC codec for repeating patterns", async () => {
+    const timestamps = [];
+    const values = [];
+
+    for (let i = 0; i < 5000; i++) {
+      timestamps.push(i * 60000);
+      values.push(
+        Math.floor(i / 288) * 0.37 +
+          Math.round(Math.sin(((i % 288) * Math.PI) / 144) * 5000) / 100 +
+          (i % 1000 === 999 ? 100 : 60)
+      );
+    }
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    const gorillaResult = await GorillaCodec.encode({ timestamps, values }, { sampleSize: 0 });
+
+    assert.equal(GorillaCodec.inspect(encodeResult).valueType, GorillaCodec.CompressionType.FLOAT_FPC_ENCODER);
+    assert.ok(encodeResult.length < gorillaResult.length / 2);
+    assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), { timestamps, values });
+
+    for (const count of [1, 2, 3, 17]) {
+      const shortResult = await GorillaCodec.encode({ timestamps: timestamps.slice(0, count), values: values.slice(0, count) });
+      const decodedValues = new Float64Array(count);
+
+      GorillaCodec.decodeInto(shortResult, { values: decodedValues });
+      assert.deepStrictEqual(Array.from(decodedValues), values.slice(0, count));
+    }
+  });
+
+  it("Splits noisy floats into snappy compressed byte planes", { skip: !snappyCompresses }, async () => {
+    const timestamps = [];
+    const values = [];
+
+    // Interleaved readings whose noise stays in the low three bytes, so the high byte planes repeat
+    for (let i = 0; i < 5000; i++) {
+      timestamps.push(i * 1000);
+      values.push([0.5, 70, 9000][i % 3] * (1 + (Math.abs(Math.sin(i * 12.9898) * 43758.5453) % 1) * 2 ** -29));
+    }
+
+    for (const count of [5000, 203]) {
+      const encodeResult = await GorillaCodec.encode({ timestamps: timestamps.slice(0, count), values: values.slice(0, count) });
+      const gorillaResult = await GorillaCodec.encode(
+        { timestamps: timestamps.slice(0, count), values: values.slice(0, count) },
+        { sampleSize: 0 }
+      );
+      const info = GorillaCodec.inspect(encodeResult);
+
+      assert.equal(info.valueType, GorillaCodec.CompressionType.FLOAT_SHUFFLE_ENCODER);
+      assert.equal(encodeResult[info.headerBytes + info.timestampBytes + 1], 1, "SHUFFLE_SNAPPY");
+      assert.ok(info.valueBytes * 2 < GorillaCodec.inspect(gorillaResult).valueBytes);
+      assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), {
+        timestamps: timestamps.slice(0, count),
+        values: values.slice(0, count),
+      });
+
+      const decodedValues = new Float64Array(count);
+
+      GorillaCodec.decodeInto(encodeResult, { values: decodedValues });
+      assert.deepStrictEqual(Array.from(decodedValues), values.slice(0, count));
+    }
+  });
+
+  it("Decodes noisy floats stored as raw byte planes", async () => {
+    const timestamps = [];
+    const values = [];
+
+    // 16 and 8 value blocks and a tail go through the different unshuffle paths
+    for (let i = 0; i < 1003; i++) {
+      timestamps.push(i * 1000);
+      values.push([0.5, 70, 9000][i % 3] * (1 + (Math.abs(Math.sin(i * 12.9898) * 43758.5453) % 1) * 2 ** -29));
+    }
+
+    // Planes that snappy would not shrink are stored as they are, behind SHUFFLE_PLANES
+    const bytes = new Uint8Array(new Float64Array(values).buffer);
+    const planes = Buffer.alloc(bytes.length);
+
+    for (let i = 0; i < values.length; i++) {
+      for (let k = 0; k < 8; k++) planes[k * values.length + i] = bytes[i * 8 + k];
+    }
+
+    const gorillaResult = await GorillaCodec.encode({ timestamps, values }, { sampleSize: 0 });
+    const info = GorillaCodec.inspect(gorillaResult);
+    const valuesSection = info.headerBytes + info.timestampBytes;
+    const stored = Buffer.concat([
+      gorillaResult.subarray(0, valuesSection),
+      Buffer.from([GorillaCodec.CompressionType.FLOAT_SHUFFLE_ENCODER, 0]),
+      planes,
+    ]);
+
+    assert.equal(GorillaCodec.inspect(stored).valueType, GorillaCodec.CompressionType.FLOAT_SHUFFLE_ENCODER);
+    assert.deepStrictEqual(await GorillaCodec.decode(stored), { timestamps, values });
+
+    const decodedValues = new Float64Array(values.length);
+
+    GorillaCodec.decodeInto(stored, { values: decodedValues });
+    assert.deepStrictEqual(Array.from(decodedValues), values);
+
+    await assert.rejects(GorillaCodec.decode(stored.subarray(0, stored.length - 1)), /Invalid data format/);
+  });
+
+  it("Codes flatlines as runs of repeats", async () => {
+    const timestamps = [];
+    const values = [];
+
+    // Holds of 1 to 4 values stay single repeats, the longer ones need one to three varint bytes
+    for (const hold of [1, 3, 4, 5, 6, 132, 133, 900, 1, 2, 20000, 7]) {
+      for (let i = 0; i < hold; i++) {
+        timestamps.push(timestamps.length * 1000);
+        values.push(hold / 8);
+      }
+    }
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    const gorillaResult = await GorillaCodec.encode({ timestamps, values }, { sampleSize: 0 });
+
+    assert.equal(GorillaCodec.inspect(encodeResult).valueType, GorillaCodec.CompressionType.FLOAT_RUNS_ENCODER);
+    assert.ok(GorillaCodec.inspect(encodeResult).valueBytes * 20 < GorillaCodec.inspect(gorillaResult).valueBytes);
+    assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), { timestamps, values });
+
+    const decodedValues = new Float64Array(values.length);
+
+    GorillaCodec.decodeInto(encodeResult, { values: decodedValues });
+    assert.deepStrictEqual(Array.from(decodedValues), values);
+
+    const nullableValues = values.map((value, i) => (i % 1000 === 10 ? null : value));
+    const nullableResult = await GorillaCodec.encode({ timestamps, values: nullableValues });
+
+    assert.deepStrictEqual(await GorillaCodec.decode(nullableResult), { timestamps, values: nullableValues });
+  });
+
+  it("Stores whole numbers through the integer codec", async () => {
+    const timestamps = [];
+    const counter = [];
+    const depth = [];
+    const bytes = [];
+
+    for (let i = 0; i < 3001; i++) {
+      timestamps.push(i * 1000);
+      counter.push(i * 40 + (i % 7) * 3);
+      depth.push((depth[i - 1] ?? 0) + (Math.round(Math.abs(Math.sin(i * 12.9898)) * 43758) % 7) - 3);
+      bytes.push((Math.round(Math.abs(Math.sin(i * 78.233)) * 43758) % 101) * 4096);
+    }
+
+    const highest = depth.map((value) => Number.MAX_SAFE_INTEGER - 5000 + value);
+    const lowest = depth.map((value) => Number.MIN_SAFE_INTEGER + 5000 + value);
+
+    for (const values of [counter, depth, bytes, highest, lowest]) {
+      const count = values.length;
+      const encodeResult = await GorillaCodec.encode({ timestamps: timestamps.slice(0, count), values });
+      const gorillaResult = await GorillaCodec.encode({ timestamps: timestamps.slice(0, count), values }, { sampleSize: 0 });
+
+      assert.equal(GorillaCodec.inspect(encodeResult).valueType, GorillaCodec.CompressionType.FLOAT_INTEGER_ENCODER);
+      assert.equal(GorillaCodec.inspect(gorillaResult).valueType, GorillaCodec.CompressionType.FLOAT_ENCODER);
+      assert.ok(encodeResult.length < gorillaResult.length);
+      assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), { timestamps: timestamps.slice(0, count), values });
+
+      const decodedValues = new Float64Array(count);
+
+      GorillaCodec.decodeInto(encodeResult, { values: decodedValues });
+      assert.deepStrictEqual(Array.from(decodedValues), values);
+    }
+
+    // -0 would come back as 0, and values past the safe range are not exact
+    for (const values of [[1, 2, -0, 4], [1, 2, 2 ** 53, 4], [1, 2, 2.5, 4]]) {
+      const encodeResult = await GorillaCodec.encode({ timestamps: [1, 2, 3, 4], values });
+
+      assert.notEqual(GorillaCodec.inspect(encodeResult).valueType, GorillaCodec.CompressionType.FLOAT_INTEGER_ENCODER);
+      assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), { timestamps: [1, 2, 3, 4], values });
+    }
+
+    const nullableValues = counter.map((value, i) => (i % 100 === 3 ? null : value));
+    const nullableResult = await GorillaCodec.encode({ timestamps, values: nullableValues });
+
+    assert.deepStrictEqual(await GorillaCodec.decode(nullableResult), { timestamps, values: nullableValues });
+  });
+});
+
+describe("Nulls", () => {
+  it("Round trips null values of every type", async () => {
+    const timestamps = [1, 2, 3, 4, 5, 6];
+
+    for (const values of [
+      [1.5, null, 2.5, null, null, 3.5],
+      ["up", null, "down", "up", null, "up"],
+      [true, false, null, true, null, false],
+      [null, null, null, null, null, null],
+    ]) {
+      const encodeResult = await GorillaCodec.encode({ timestamps, values });
+
+      assert.equal(GorillaCodec.inspect(encodeResult).valueType, GorillaCodec.CompressionType.NULLABLE_ENCODER);
+      assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), { timestamps, values });
+    }
+  });
+
+  it("Keeps nulls out of the value codec", async () => {
+    const timestamps = [];
+    const nulls = [];
+    const nans = [];
+
+    for (let i = 0; i < 10000; i++) {
+      const value = i % 10 === 0 ? 20 + Math.sin(i / 100) : null;
+
+      timestamps.push(i * 1000);
+      nulls.push(value);
+      nans.push(value ?? NaN);
+    }
+
+    // Both with Gorilla XOR encoding, so only the handling of the missing values differs
+    const nullResult = await GorillaCodec.encode({ timestamps, values: nulls }, { sampleSize: 0 });
+    const nanResult = await GorillaCodec.encode({ timestamps, values: nans }, { sampleSize: 0 });
+
+    assert.ok(GorillaCodec.inspect(nullResult).valueBytes < GorillaCodec.inspect(nanResult).valueBytes / 2);
+    assert.deepStrictEqual(await GorillaCodec.decode(nullResult), { timestamps, values: nulls });
+    assert.deepStrictEqual(await GorillaCodec.decode(nullResult, { from: 5000, to: 20000 }), {
+      timestamps: timestamps.slice(5, 21),
+      values: nulls.slice(5, 21),
+    });
+  });
+});
+
+describe("Columns", () => {
+  const timestamps = [];
+  const columns = { user: [], system: [], idle: [], state: [] };
+
+  for (let i = 0; i < 1000; i++) {
+    timestamps.push(1704747969000 + i * 15000);
+    columns.user.push(Math.round(Math.random() * 1000) / 10);
+    columns.system.push(Math.round(Math.random() * 100) / 10);
+    columns.idle.push(100 - columns.user[i] / 2);
+    columns.state.push(i % 100 < 90 ? "running" : "throttled");
+  }
+
+  it("Shares one timestamps section between columns", async () => {
+    const encodeResult = await GorillaCodec.encode({ timestamps, columns });
+
+    assert.deepStrictEqual(await GorillaCodec.decode(encodeResult), { timestamps, columns });
+
+    let separateBytes = 0;
+    for (const values of Object.values(columns)) {
+      separateBytes += (await GorillaCodec.encode({ timestamps, values })).length;
+    }
+
+    assert.ok(encodeResult.length < separateBytes);
+
+    const info = GorillaCodec.inspect(encodeResult);
+    assert.equal(info.valueType, GorillaCodec.CompressionType.MULTI_COLUMN_ENCODER);
+    assert.deepStrictEqual(
+      info.columns.map((column) => column.name),
+      ["user", "system", "idle", "state"]
+    );
+    assert.equal(info.columns[3].valueType, GorillaCodec.CompressionType.STRING_DICTIONARY_ENCODER);
+  });
+
+  it("Decodes selected columns only", async () => {
+    const encodeResult = await GorillaCodec.encode({ timestamps, columns });
+
+    assert.deepStrictEqual(await GorillaCodec.decode(encodeResult, { columns: ["idle", "state"] }), {
+      timestamps,
+      columns: { idle: columns.idle, state: columns.state },
+    });
+  });
+
+  it("Rejects columns of the wrong length", () => {
+    assert.throws(() => GorillaCodec.encode({ timestamps: [1, 2], columns: { a: [1, 2], b: [1] } }));
+    assert.throws(() => GorillaCodec.encode({ timestamps: [1, 2], columns: {} }));
+  });
+});
+
+describe("Inspect", () => {
+  it("Reads the header without decoding", async () => {
+    const timestamps = [3000, 1000, 2000, 5000, 4000];
+    const values = [1.5, 2.5, 3.5, 4.5, 5.5];
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    const info = GorillaCodec.inspect(encodeResult);
+
+    assert.equal(info.count, 5);
+    assert.equal(info.timestampType, GorillaCodec.CompressionType.INTEGER_SCALED_ENCODER);
+    assert.equal(info.valueType, GorillaCodec.CompressionType.FLOAT_ENCODER);
+    assert.equal(info.minTimestamp, 1000);
+    assert.equal(info.maxTimestamp, 5000);
+    assert.equal(info.headerBytes + info.timestampBytes + info.valueBytes, encodeResult.length);
+  });
+
+  it("Inspects an empty buffer", async () => {
+    const encodeResult = await GorillaCodec.encode({ timestamps: [], values: [] });
+    const info = GorillaCodec.inspect(encodeResult);
+
+    assert.equal(info.count, 0);
+    assert.equal(info.minTimestamp, undefined);
+  });
+
+  it("Rejects truncated buffers", () => {
+    assert.throws(() => GorillaCodec.inspect(Buffer.from([0, 1, 0])));
+  });
+});
+
+describe("EncodeInto", () => {
+  it("Writes into a caller owned buffer at an offset", async () => {
+    const data = {
+      timestamps: [1000, 2000, 3000, 4000],
+      columns: { load: [0.5, 0.25, null, 1.5], state: ["up", "up", "down", "up"] },
+    };
+
+    const encodeResult = await GorillaCodec.encode(data);
+    const slab = Buffer.alloc(8 + GorillaCodec.encodeBound(data));
+
+    assert.ok(GorillaCodec.encodeBound(data) >= encodeResult.length);
+    assert.equal(await GorillaCodec.encodeInto(data, slab, 8), encodeResult.length);
+    assert.deepStrictEqual(slab.subarray(8, 8 + encodeResult.length), encodeResult);
+    assert.deepStrictEqual(await GorillaCodec.decode(slab.subarray(8)), data);
+  });
+
+  it("Bounds the worst case of every value type", async () => {
+    const timestamps = [];
+    const floats = [];
+    const strings = [];
+
+    for (let i = 0; i < 1000; i++) {
+      timestamps.push(Math.floor(Math.random() * 2 ** 40));
+      floats.push(Math.random() * 1e300 * (i % 2 ? -1 : 1));
+      strings.push(Math.random().toString(36));
+    }
+
+    for (const values of [floats, strings, floats.map((value) => value > 0)]) {
+      const data = { timestamps, values };
+      const encodeResult = await GorillaCodec.encode(data, { sampleSize: 0 });
+
+      assert.ok(GorillaCodec.encodeBound(data) >= encodeResult.length);
+    }
+  });
+
+  it("Rejects buffers that are too small", async () => {
+    const data = { timestamps: [1, 2, 3], values: [1.5, 2.5, 3.5] };
+
+    await assert.rejects(GorillaCodec.encodeInto(data, Buffer.alloc(8)), RangeError);
+    assert.throws(() => GorillaCodec.encodeInto(data, Buffer.alloc(64), 65), RangeError);
+    assert.throws(() => GorillaCodec.encodeInto(data, [], 0), TypeError);
+  });
+});
+
+describe("DecodeInto", () => {
+  it("Decodes into caller owned arrays at an offset", async () => {
+    const timestamps = [1000, 2000, 3000, 4000];
+    const values = [1.5, null, 2.5, 3.5];
+
+    const encodeResult = await GorillaCodec.encode({ timestamps, values });
+    const timestampsTarget = new BigUint64Array(6);
+    const valuesTarget = new Float64Array(6);
+
+    assert.equal(
+      GorillaCodec.decodeInto(encodeResult, { timestamps: timestampsTarget, values: valuesTarget, offset: 2 }),
+      4
+    );
+    assert.deepStrictEqual([...timestampsTarget], [0n, 0n, 1000n, 2000n, 3000n, 4000n]);
+    assert.deepStrictEqual([...valuesTarget], [0, 0, 1.5, NaN, 2.5, 3.5]);
+
+    const booleanResult = await GorillaCodec.encode({ timestamps, values: [true, false, false, true] });
+    const floatTimestamps = new Float64Array(4);
+    const booleans = new Uint8Array(4);
+
+    GorillaCodec.decodeInto(booleanResult, { timestamps: floatTimestamps, values: booleans });
+    assert.deepStrictEqual([...floatTimestamps], timestamps);
+    assert.deepStrictEqual([...booleans], [1, 0, 0, 1]);
+  });
+
+  it("Rejects targets that are too small or of the wrong type", async () => {
+    const encodeResult = await GorillaCodec.encode({ timestamps: [1, 2, 3], values: [1.5, 2.5, 3.5] });
+    const stringResult = await GorillaCodec.encode({ timestamps: [1, 2, 3], values: ["a", "b", "c"] });
+
+    assert.throws(() => GorillaCodec.decodeInto(encodeResult, { values: new Float64Array(3), offset: 1 }), RangeError);
+    assert.throws(() => GorillaCodec.decodeInto(encodeResult, { values: new Uint8Array(3) }), TypeError);
+    assert.throws(() => GorillaCodec.decodeInto(stringResult, { values: new Float64Array(3) }), TypeError);
+    assert.throws(() => GorillaCodec.decodeInto(encodeResult, { values: [] }), TypeError);
+    assert.throws(() => GorillaCodec.decodeInto(encodeResult, { values: new Float64Array(3), offset: "1" }), TypeError);
+  });
+});
+
+describe("Corrupt", () => {
+  const timestamps = [];
+  const columns = { load: [], up: [], state: [] };
+
+  for (let i = 0; i < 300; i++) {
+    timestamps.push(1704747969000 + i * 15000);
+    columns.load.push(i % 7 ? Math.round(Math.sin(i / 10) * 1000) / 10 : null);
+    columns.up.push(i % 50 < 40);
+    columns.state.push(i % 11 ? ["running", "throttled", "stopped"][i % 3] : null);
+  }
+
+  it("Rejects buffers with fewer values than they claim", async () => {
+    const encodeResult = await GorillaCodec.encode({ timestamps, columns });
+    const values = await GorillaCodec.encode({ timestamps, values: columns.up });
+
+    const forged = Buffer.from(values);
+    forged.writeUInt32LE(timestamps.length * 100, 1);
+
+    await assert.rejects(GorillaCodec.decode(encodeResult.subarray(0, encodeResult.length - 16)), /Invalid data format/);
+    await assert.rejects(GorillaCodec.decode(forged), /Invalid data format/);
+    assert.throws(() => GorillaCodec.decodeInto(values.subarray(0, values.length - 4), { values: new Uint8Array(300) }));
+    assert.throws(() => GorillaCodec.decodeInto(forged, { timestamps: new Float64Array(30000) }), /Invalid data format/);
+  });
+
+  it("Rejects nullable sections nested in nullable sections", async () => {
+    const outer = await GorillaCodec.encode({ timestamps: [1, 2, 3], values: [1.5, null, 2.5] });
+    const inner = await GorillaCodec.encode({ timestamps: [1, 2], values: [4.5, null] });
+
+    const outerInfo = GorillaCodec.inspect(outer);
+    const innerInfo = GorillaCodec.inspect(inner);
+    const outerSection = outerInfo.headerBytes + outerInfo.timestampBytes;
+    const innerSection = innerInfo.headerBytes + innerInfo.timestampBytes;
+
+    assert.equal(outerInfo.valueType, GorillaCodec.CompressionType.NULLABLE_ENCODER);
+    assert.equal(innerInfo.valueType, GorillaCodec.CompressionType.NULLABLE_ENCODER);
+
+    // The outer validity, followed by a whole nullable section for its two present values
+    const validityEnd = outerSection + 5 + outer.readUInt32LE(outerSection + 1);
+    const nested = Buffer.concat([outer.subarray(0, validityEnd), inner.subarray(innerSection)]);
+
+    assert.throws(() => GorillaCodec.decodeInto(nested, { values: new Float64Array(3) }), /Invalid data format/);
+  });
+
+  it("Rejects float streams cut short", async () => {
+    const walk = [];
+    for (let i = 0; i < 500; i++) walk.push(Math.round(((walk[i - 1] ?? 50) + Math.sin(i * 12.9898) * 3) * 1000) / 1000);
+
+    const series = { timestamps: walk.map((_, i) => 1704747969000 + i * 15000), values: walk };
+    const encoded = [
+      await GorillaCodec.encode(series, { sampleSize: 0 }),
+      await GorillaCodec.encode(series, { sampleSize: 0, highRatio: true }),
+      await GorillaCodec.encode({ ...series, values: new Float32Array(walk) }),
+    ];
+
+    for (const encodeResult of encoded) {
+      for (const cut of [64, 400, 1000]) {
+        const truncated = encodeResult.subarray(0, encodeResult.length - cut);
+
+        await assert.rejects(GorillaCodec.decode(truncated), /Invalid data format/);
+        assert.throws(() => GorillaCodec.decodeInto(truncated, { values: new Float64Array(500) }), /Invalid data format/);
+      }
+    }
+  });
+
+  it("Rejects snappy string sections holding another number of strings", async () => {
+    const strings = [];
+    for (let i = 0; i < 21; i++) strings.push(`${i * 7919}-${(i * 104729) % 1000}`);
+
+    const encodeResult = await GorillaCodec.encode({ timestamps: timestamps.slice(0, 20), values: strings.slice(0, 20) });
+    const info = GorillaCodec.inspect(encodeResult);
+    assert.equal(info.valueType, GorillaCodec.CompressionType.STRING_ENCODER);
+
+    // The values section of 21 strings after the header and timestamps of 20
+    const longer = await GorillaCodec.encode({ timestamps: timestamps.slice(0, 21), values: strings });
+    const longerInfo = GorillaCodec.inspect(longer);
+    assert.equal(longerInfo.valueType, GorillaCodec.CompressionType.STRING_ENCODER);
+
+    const valuesOffset = ({ headerBytes, timestampBytes }) => headerBytes + timestampBytes;
+    const spliced = Buffer.concat([
+      encodeResult.subarray(0, valuesOffset(info)),
+      longer.subarray(valuesOffset(longerInfo)),
+    ]);
+
+    await assert.rejects(GorillaCodec.decode(spliced), /Invalid data format/);
+
+    // Snappy starts with a literal, so the first length prefix is stored as it is
+    const prefix = Buffer.alloc(4);
+    prefix.writeUInt32LE(strings[0].length);
+
+    const lengthOffset = encodeResult.indexOf(Buffer.concat([prefix, Buffer.from(strings[0])]), valuesOffset(info));
+    assert.ok(lengthOffset > 0);
+
+    const forged = Buffer.from(encodeResult);
+    forged.writeUInt32LE(0xffff, lengthOffset);
+
+    await assert.rejects(GorillaCodec.decode(forged), /Invalid data format/);
+  });
+
+  it("Rejects dictionary string sections holding another number of codes", async () => {
+    const states = [];
+    for (let i = 0; i < 21; i++) states.push(["ok", "warning", "critical"][i % 3]);
+
+    const encodeResult = await GorillaCodec.encode({ timestamps: timestamps.slice(0, 20), values: states.slice(0, 20) });
+    const info = GorillaCodec.inspect(encodeResult);
+    assert.equal(info.valueType, GorillaCodec.CompressionType.STRING_DICTIONARY_ENCODER);
+
+    // The codes of 21 strings after the header and timestamps of 20
+    const longer = await GorillaCodec.encode({ timestamps: timestamps.slice(0, 21), values: states });
+    const longerInfo = GorillaCodec.inspect(longer);
+    assert.equal(longerInfo.valueType, GorillaCodec.CompressionType.STRING_DICTIONARY_ENCODER);
+
+    const valuesOffset = ({ headerBytes, timestampBytes }) => headerBytes + timestampBytes;
+    const spliced = Buffer.concat([
+      encodeResult.subarray(0, valuesOffset(info)),
+      longer.subarray(valuesOffset(longerInfo)),
+    ]);
+
+    await assert.rejects(GorillaCodec.decode(spliced), /Invalid data format/);
+  });
+
+  it("Decodes or rejects every single byte corruption", async () => {
+    const encodeResult = await GorillaCodec.encode({ timestamps, columns });
+    const values = await GorillaCodec.encode({ timestamps, values: columns.load });
+
+    for (let i = 0; i < encodeResult.length; i++) {
+      const corrupt = Buffer.from(encodeResult);
+      corrupt[i] ^= 0xa5;
+
+      await GorillaCodec.decode(corrupt).catch((error) => assert.match(error.message, /Invalid data format/));
+    }
+
+    for (let i = 0; i < values.length; i++) {
+      const corrupt = Buffer.from(values);
+      corrupt[i] ^= 0xa5;
+
+      try {
+        GorillaCodec.decodeInto(corrupt, { timestamps: new Float64Array(300), values: new Float64Array(300) });
+      } catch (error) {
+        assert.ok(error instanceof Error);
+      }
+    }
+  });
+});
+
+describe("Segment", () => {
+  const directory = mkdtempSync(join(tmpdir(), "gorilla-segment-"));
+  const path = join(directory, "series.seg");
+
+  it("Decodes series and time ranges from a segment", async () => {
+    const cpu = [
+      { timestamps: [1000, 2000, 3000], values: [0.5, 0.25, 0.75] },
+      { timestamps: [4000, 5000, 6000], values: [0.5, 1, 0.125] },
+    ];
+    const state = { timestamps: [1000, 2000, 3000, 4000], values: ["up", "up", "down", "up"] };
+
+    await GorillaCodec.writeSegment(path, [
+      { id: "cpu", buffer: await GorillaCodec.encode(cpu[1]) },
+      { id: "state", buffer: await GorillaCodec.encode(state) },
+      { id: "cpu", buffer: await GorillaCodec.encode(cpu[0]) },
+    ]);
+
+    const segment = GorillaCodec.openSegment(path);
+
+    try {
+      assert.deepStrictEqual(
+        segment.series().map(({ id, count, minTimestamp }) => [id, count, minTimestamp]),
+        [
+          ["cpu", 3, 1000],
+          ["cpu", 3, 4000],
+          ["state", 4, 1000],
+        ]
+      );
+
+      assert.deepStrictEqual(await segment.decode("cpu"), {
+        timestamps: [...cpu[0].timestamps, ...cpu[1].timestamps],
+        values: [...cpu[0].values, ...cpu[1].values],
+      });
+
+      assert.deepStrictEqual(await segment.decode("cpu", { from: 2500, to: 4000 }), {
+        timestamps: [3000, 4000],
+        values: [0.75, 0.5],
+      });
+
+      assert.deepStrictEqual(await segment.decode("state", { from: 2000, to: 3000 }), {
+        timestamps: [2000, 3000],
+        values: ["up", "down"],
+      });
+
+      assert.deepStrictEqual(await segment.decode("cpu", { from: 7000 }), { timestamps: [], values: [] });
+      assert.throws(() => segment.decode("memory"));
+    } finally {
+      segment.close();
+    }
+
+    assert.throws(() => segment.decode("cpu"));
+  });
+
+  it("Joins blocks of nulls to blocks of values", async () => {
+    const nullsPath = join(directory, "nulls.seg");
+    const floats = { timestamps: [1, 2, 3], values: [0.5, 1.5, 2.5] };
+    const nulls = { timestamps: [4, 5, 6], values: [null, null, null] };
+    const more = { timestamps: [7, 8], values: [3.5, 4.5] };
+    const strings = { timestamps: [9], values: ["up"] };
+
+    await GorillaCodec.writeSegment(nullsPath, [
+      { id: "middle", buffer: await GorillaCodec.encode(floats) },
+      { id: "middle", buffer: await GorillaCodec.encode(nulls) },
+      { id: "middle", buffer: await GorillaCodec.encode(more) },
+      { id: "first", buffer: await GorillaCodec.encode({ timestamps: [0], values: [null] }) },
+      { id: "first", buffer: await GorillaCodec.encode(floats) },
+      { id: "mixed", buffer: await GorillaCodec.encode(floats) },
+      { id: "mixed", buffer: await GorillaCodec.encode(strings) },
+    ]);
+
+    const segment = GorillaCodec.openSegment(nullsPath);
+
+    try {
+      assert.deepStrictEqual(await segment.decode("middle"), {
+        timestamps: [1, 2, 3, 4, 5, 6, 7, 8],
+        values: [0.5, 1.5, 2.5, null, null, null, 3.5, 4.5],
+      });
+
+      assert.deepStrictEqual(await segment.decode("first"), {
+        timestamps: [0, 1, 2, 3],
+        values: [null, 0.5, 1.5, 2.5],
+      });
+
+      await assert.rejects(segment.decode("mixed"), /value types/);
+    } finally {
+      segment.close();
+    }
+  });
+
+  it("Rejects files that are not segments", async () => {
+    const invalidPath = join(directory, "invalid.seg");
+    writeFileSync(invalidPath, Buffer.alloc(64, 1));
+
+    assert.throws(() => GorillaCodec.openSegment(invalidPath));
+    assert.throws(() => GorillaCodec.openSegment(join(directory, "missing.seg")));
+
+    // A forged entry count is rejected before any entry is read
+    await GorillaCodec.writeSegment(invalidPath, [
+      { id: "cpu", buffer: await GorillaCodec.encode({ timestamps: [1], values: [0.5] }) },
+    ]);
+
+    const forged = readFileSync(invalidPath);
+    forged.writeUInt32LE(0xffffffff, forged.length - 8);
+    writeFileSync(invalidPath, forged);
+
+    assert.throws(() => GorillaCodec.openSegment(invalidPath), /Invalid segment index/);
+
+    rmSync(directory, { recursive: true, force: true });
+  });
+});
+
+describe("Stats", () => {
+  it("Records per stage and per type timings", async () => {
+    GorillaCodec.resetStats();
+
+    const timestamps = [1, 2, 3, 4, 5];
+    const values = [1.5, 2.5, 3.5, 4.5, 5.5];
+
+    await GorillaCodec.decode(await GorillaCodec.encode({ timestamps, values }));
+
+    const stats = GorillaCodec.getStats();
+
+    if (!stats.compiled) return;
+
+    for (const stage of ["marshal", "timestampEncode", "valueEncode", "output", "inputCopy", "timestampDecode", "valueDecode", "resultBuild"]) {
+      assert.equal(stats.stages[stage].count, 1, stage);
+      assert.equal(
+        stats.stages[stage].histogram.reduce((sum, bucket) => sum + bucket.count, 0),
+        1
+      );
+    }
+
+    assert.equal(stats.types.FLOAT_ENCODER.encode.count, 1);
+    assert.equal(stats.types.FLOAT_ENCODER.decode.count, 1);
+    assert.ok(stats.types.FLOAT_ENCODER.decode.bytes > 0);
+  });
+
+  it("Can be turned off at run time", async () => {
+    GorillaCodec.resetStats();
+    GorillaCodec.setStatsEnabled(false);
+
+    try {
+      await GorillaCodec.encode({ timestamps: [1, 2], values: [true, false] });
+
+      const stats = GorillaCodec.getStats();
+      assert.equal(stats.enabled, false);
+      assert.equal(stats.stages.valueEncode.count, 0);
+    } finally {
+      GorillaCodec.setStatsEnabled(true);
+    }
+  });
 });